@@ -0,0 +1,428 @@
+// Micro-benchmarks for transforms.cpp
+//
+// Reports ns/op and throughput for matrix multiply, rotation, composed body
+// transforms, batch transforms, batch Kepler orbits and UV sphere generation -
+// for every kernel this CPU supports and for the glm equivalents. Sphere
+// output from every kernel and from the job system is checked byte for byte
+// against the per-vertex loop it replaced (exits with 1 if any differ).
+//
+// Usage: transforms_bench [min seconds per benchmark (default 0.25)] [batch bodies (default 100000)]
+//                         [sphere rings and columns (default 1024)]
+
+// System Headers
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// GLM Headers
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Project Headers
+#include "transforms.h"
+#include "aligned.h"
+#include "kepler.h"
+#include "geometry.h"
+#include "jobs.h"
+
+// --------------------------------------------------------------------------------
+// Benchmark Harness
+// --------------------------------------------------------------------------------
+
+// Minimum time spent in each benchmark
+static double min_seconds = 0.25;
+
+// Results are summed here so the compiler cannot remove the work
+static volatile float sink = 0.0f;
+
+// Print one result line
+static void report(const char *name, const char *kernel, double seconds, double ops) {
+	double ns = 1e9 * seconds / ops;
+	std::cout << std::left << std::setw(28) << name << std::setw(8) << kernel
+	          << std::right << std::fixed << std::setprecision(2) << std::setw(10) << ns << " ns/op"
+	          << std::setw(12) << 1e-6 * ops / seconds << " Mop/s" << std::endl;
+}
+
+// Run fn (which performs ops_per_call operations) until min_seconds have passed
+template<typename F>
+static void benchmark(const char *name, const char *kernel, double ops_per_call, F fn) {
+	// Warm up
+	fn();
+
+	// Double the calls per batch until the batch is long enough to time
+	unsigned long calls = 1;
+	while(true) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(unsigned long i = 0; i < calls; i++) {
+			fn();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if(seconds >= min_seconds) {
+			report(name, kernel, seconds, calls * ops_per_call);
+			return;
+		}
+		calls *= 2;
+	}
+}
+
+// --------------------------------------------------------------------------------
+// Benchmarks
+// --------------------------------------------------------------------------------
+
+// Number of independent operations per call (amortises the loop and timer)
+const int OPS = 256;
+
+// Matrix multiply
+static void benchmarkMultiply() {
+	// Small rotation so repeated products stay bounded
+	float step[16];
+	rotateY(0.001f, step);
+
+	// float[16] reference
+	{
+		float m[16];
+		rotateY(0.5f, m);
+		benchmark("multiply44(float[16])", "scalar", OPS, [&]() {
+			float t[16];
+			for(int i = 0; i < OPS; i += 2) {
+				multiply44(m, step, t);
+				multiply44(t, step, m);
+			}
+			sink = sink + m[0];
+		});
+	}
+
+	// Matrix44 with every supported kernel
+	const TransformKernel kernels[] = {TRANSFORM_SCALAR, TRANSFORM_SSE2, TRANSFORM_AVX2, TRANSFORM_NEON};
+	for(TransformKernel kernel : kernels) {
+		if(!isTransformKernelSupported(kernel)) {
+			continue;
+		}
+		setTransformKernel(kernel);
+
+		Matrix44 m, s;
+		rotateY(0.5f, m.m);
+		rotateY(0.001f, s.m);
+		benchmark("multiply44(Matrix44)", getTransformKernelName(kernel), OPS, [&]() {
+			for(int i = 0; i < OPS; i++) {
+				multiply44(m, s, m);
+			}
+			sink = sink + m.m[0];
+		});
+	}
+
+	// glm
+	{
+		glm::mat4 m = glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 s = glm::rotate(glm::mat4(1.0f), 0.001f, glm::vec3(0.0f, 1.0f, 0.0f));
+		benchmark("mat4 * mat4", "glm", OPS, [&]() {
+			for(int i = 0; i < OPS; i++) {
+				m = m * s;
+			}
+			sink = sink + m[0][0];
+		});
+	}
+}
+
+// Rotation matrix
+static void benchmarkRotate() {
+	float angle = 0.0f;
+	benchmark("rotateY", "scalar", OPS, [&]() {
+		float r[16];
+		for(int i = 0; i < OPS; i++) {
+			rotateY(angle, r);
+			angle += r[0] * 1e-6f;
+		}
+		sink = sink + angle;
+	});
+
+	angle = 0.0f;
+	benchmark("rotate(mat4, angle, Y)", "glm", OPS, [&]() {
+		for(int i = 0; i < OPS; i++) {
+			glm::mat4 r = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+			angle += r[0][0] * 1e-6f;
+		}
+		sink = sink + angle;
+	});
+}
+
+// One body transform - rotateY(o) * translate(d) * rotateY(s) * scale(r)
+static void benchmarkCompose() {
+	float angle = 0.0f;
+
+	// Five matrices and three products (as main.cpp used to build them)
+	benchmark("compose (matrix chain)", "scalar", OPS, [&]() {
+		for(int i = 0; i < OPS; i++) {
+			float sc[16], translation[16], rot_around[16], rot_inplace[16];
+			float temp[16], temp2[16], model[16];
+			scale(0.1f, 0.1f, 0.1f, sc);
+			translate(1.5f, 0.0f, 0.0f, translation);
+			rotateY(angle, rot_around);
+			rotateY(angle * 2.0f, rot_inplace);
+			multiply44(translation, rot_inplace, temp);
+			multiply44(rot_around, temp, temp2);
+			multiply44(temp2, sc, model);
+			angle += model[0] * 1e-6f;
+		}
+		sink = sink + angle;
+	});
+
+	// Closed form for a single body - both rotations are around Y, so the chain is
+	// a rotation by the summed angles scaled by r, translated to (d cos(o), 0, -d sin(o))
+	angle = 0.0f;
+	benchmark("compose (closed form)", getTransformKernelName(getTransformKernel()), OPS, [&]() {
+		for(int i = 0; i < OPS; i++) {
+			float x = 1.5f * cosf(angle), y = 0.0f, z = -1.5f * sinf(angle);
+			float spin = angle * 3.0f, radius = 0.1f;
+			float model[16];
+			composeBodyTransforms(&x, &y, &z, &spin, &radius, model, 1);
+			angle += model[0] * 1e-6f;
+		}
+		sink = sink + angle;
+	});
+
+	// glm chain
+	angle = 0.0f;
+	benchmark("compose", "glm", OPS, [&]() {
+		for(int i = 0; i < OPS; i++) {
+			glm::mat4 model = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+			model = glm::translate(model, glm::vec3(1.5f, 0.0f, 0.0f));
+			model = glm::rotate(model, angle * 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+			model = glm::scale(model, glm::vec3(0.1f));
+			angle += model[0][0] * 1e-6f;
+		}
+		sink = sink + angle;
+	});
+}
+
+// Batch of body transforms (per-body cost)
+static void benchmarkBatch(size_t count) {
+	AlignedArray<float> x, y, z, spin, radius, model;
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	spin.resize(count);
+	radius.resize(count);
+	model.resize(count * 16);
+
+	// Spread of positions, angles and sizes like an asteroid belt
+	for(size_t i = 0; i < count; i++) {
+		float orbit    = 6.2831853f * (float)rand() / RAND_MAX;
+		float distance = 2.0f + (float)rand() / RAND_MAX;
+		x[i]      = distance * cosf(orbit);
+		y[i]      = 0.02f * (float)rand() / RAND_MAX - 0.01f;
+		z[i]      = -distance * sinf(orbit);
+		spin[i]   = 6.2831853f * (float)rand() / RAND_MAX;
+		radius[i] = 0.001f + 0.01f * (float)rand() / RAND_MAX;
+	}
+
+	const TransformKernel kernels[] = {TRANSFORM_SCALAR, TRANSFORM_SSE2, TRANSFORM_AVX2, TRANSFORM_NEON};
+	for(TransformKernel kernel : kernels) {
+		if(!isTransformKernelSupported(kernel)) {
+			continue;
+		}
+		setTransformKernel(kernel);
+
+		benchmark("composeBodyTransforms", getTransformKernelName(kernel), count, [&]() {
+			composeBodyTransforms(x.data(), y.data(), z.data(), spin.data(), radius.data(), model.data(), count);
+			sink = sink + model[0];
+		});
+	}
+
+	// glm - one matrix chain per body
+	std::vector<glm::mat4> models(count);
+	benchmark("compose batch", "glm", count, [&]() {
+		for(size_t i = 0; i < count; i++) {
+			glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(x[i], y[i], z[i]));
+			m = glm::rotate(m, spin[i], glm::vec3(0.0f, 1.0f, 0.0f));
+			models[i] = glm::scale(m, glm::vec3(radius[i]));
+		}
+		sink = sink + models[0][0][0];
+	});
+}
+
+// Batch of Kepler orbit positions (per-body cost)
+static void benchmarkKepler(size_t count) {
+	AlignedArray<float> M, e, px, py, pz, qx, qy, qz, x, y, z;
+	AlignedArray<float> *columns[] = {&M, &e, &px, &py, &pz, &qx, &qy, &qz, &x, &y, &z};
+	for(AlignedArray<float> *column : columns) {
+		column->resize(count);
+	}
+
+	// Random orbits up to e = 0.9 (a long way past any planet)
+	for(size_t i = 0; i < count; i++) {
+		OrbitalElements orbit = {2.0f + (float)rand() / RAND_MAX, 0.9f * (float)rand() / RAND_MAX,
+		                         0.3f * (float)rand() / RAND_MAX, 6.2831853f * (float)rand() / RAND_MAX,
+		                         6.2831853f * (float)rand() / RAND_MAX, 0.0f, 0.0f};
+		float P[3], Q[3];
+		orbitBasis(orbit, P, Q);
+		px[i] = P[0]; py[i] = P[1]; pz[i] = P[2];
+		qx[i] = Q[0]; qy[i] = Q[1]; qz[i] = Q[2];
+		e[i] = orbit.eccentricity;
+		M[i] = 6.2831853f * (float)rand() / RAND_MAX - 3.1415927f;
+	}
+
+	const TransformKernel kernels[] = {TRANSFORM_SCALAR, TRANSFORM_SSE2, TRANSFORM_AVX2, TRANSFORM_NEON};
+	for(TransformKernel kernel : kernels) {
+		if(!isTransformKernelSupported(kernel)) {
+			continue;
+		}
+		setTransformKernel(kernel);
+
+		benchmark("solveOrbits", getTransformKernelName(kernel), count, [&]() {
+			solveOrbits(M.data(), e.data(), px.data(), py.data(), pz.data(), qx.data(), qy.data(), qz.data(),
+			            x.data(), y.data(), z.data(), count);
+			sink = sink + x[0];
+		});
+	}
+}
+
+// UV sphere as createSphereData built it before the trig tables - float sin/cos
+// and glm::normalize per vertex
+static void createSpherePerVertex(glm::vec4 *buffer, glm::ivec3 *indexes, float r, int sub1, int sub2) {
+	for(int i1 = 0; i1 < sub1; i1++) {
+		float theta = i1 * M_PI / (sub1-1);
+		int offset1 = -sub2;
+		for(int i2 = 0; i2 <= sub2; i2++) {
+			float phi = i2 * M_PI * 2.0 / sub2;
+			glm::vec4 p = glm::vec4(r*sinf(theta)*cosf(phi), r*cosf(theta), r*sinf(theta)*sinf(phi), 1.0f);
+			*buffer++ = p;
+			*buffer++ = glm::normalize(glm::vec4(p.x, p.y, p.z, 0.0f));
+			*buffer++ = glm::vec4(phi / (M_PI*2.0f), theta / M_PI, 0.0f, 1.0f);
+
+			int offset2 = (i2 < (sub2 - 1)) ? 1 : -(sub2 - 1);
+			if(i1 > 0) {
+				int k = i1*sub2 + i2;
+				*indexes++ = glm::ivec3(k + offset1, k,           k + offset2);
+				*indexes++ = glm::ivec3(k + offset1, k + offset2, k + offset1 + offset2);
+			}
+		}
+	}
+}
+
+// Print a line if a sphere differs from the reference anywhere (returns true if identical)
+static bool checkSphere(const char *name, const char *kernel,
+                        const std::vector<glm::vec4> &buffer, const std::vector<glm::ivec3> &indexes,
+                        const std::vector<glm::vec4> &reference_buffer, const std::vector<glm::ivec3> &reference_indexes) {
+	bool same = memcmp(buffer.data(), reference_buffer.data(), buffer.size() * sizeof(glm::vec4)) == 0 &&
+	            memcmp(indexes.data(), reference_indexes.data(), indexes.size() * sizeof(glm::ivec3)) == 0;
+	if(!same) {
+		std::cout << std::left << std::setw(28) << name << std::setw(8) << kernel << "  output differs from the per-vertex loop" << std::endl;
+	}
+	return same;
+}
+
+// Radius of the benchmarked sphere - not 1, so every product with r is exercised
+const float SPHERE_RADIUS = 3.7f;
+
+// UV sphere with size rings and columns (per-vertex cost) - the per-vertex
+// loop, every kernel, then rows split across the job system, each checked
+// against the per-vertex loop
+static bool benchmarkSphere(int size) {
+	const size_t vertices = getSphereVertexCount(size, size);
+	const size_t triangles = getSphereTriangleCount(size, size);
+	std::vector<glm::vec4> buffer(vertices * 3), reference_buffer(vertices * 3);
+	std::vector<glm::ivec3> indexes(triangles), reference_indexes(triangles);
+
+	// Reference
+	benchmark("sphere (per vertex)", "glm", vertices, [&]() {
+		createSpherePerVertex(reference_buffer.data(), reference_indexes.data(), SPHERE_RADIUS, size, size);
+		sink = sink + reference_buffer[3].x;
+	});
+
+	bool identical = true;
+	const TransformKernel kernels[] = {TRANSFORM_SCALAR, TRANSFORM_SSE2, TRANSFORM_AVX2, TRANSFORM_NEON};
+	for(TransformKernel kernel : kernels) {
+		if(!isTransformKernelSupported(kernel)) {
+			continue;
+		}
+		setTransformKernel(kernel);
+
+		std::fill(buffer.begin(), buffer.end(), glm::vec4(0.0f));
+		std::fill(indexes.begin(), indexes.end(), glm::ivec3(0));
+		benchmark("createSphereData", getTransformKernelName(kernel), vertices, [&]() {
+			createSphereData(buffer.data(), indexes.data(), SPHERE_RADIUS, size, size);
+			sink = sink + buffer[3].x;
+		});
+		identical &= checkSphere("createSphereData", getTransformKernelName(kernel), buffer, indexes, reference_buffer, reference_indexes);
+	}
+
+	// Rows across every hardware thread with the best kernel
+	setTransformKernel(getBestTransformKernel());
+	JobSystem jobs;
+	std::fill(buffer.begin(), buffer.end(), glm::vec4(0.0f));
+	std::fill(indexes.begin(), indexes.end(), glm::ivec3(0));
+	char name[64];
+	snprintf(name, sizeof(name), "createSphereData (%d thr)", jobs.getWorkerCount() + 1);
+	benchmark(name, getTransformKernelName(getTransformKernel()), vertices, [&]() {
+		createSphereData(buffer.data(), indexes.data(), SPHERE_RADIUS, size, size, jobs);
+		sink = sink + buffer[3].x;
+	});
+	identical &= checkSphere(name, getTransformKernelName(getTransformKernel()), buffer, indexes, reference_buffer, reference_indexes);
+
+	if(identical) {
+		std::cout << "Sphere output identical to the per-vertex loop for every kernel and thread count" << std::endl;
+	} else {
+		std::cout << "Sphere output DIFFERS from the per-vertex loop" << std::endl;
+	}
+	return identical;
+}
+
+// --------------------------------------------------------------------------------
+// Main
+// --------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+	// Options
+	size_t batch = 100000;
+	int sphere = 1024;
+	if(argc > 1) {
+		min_seconds = atof(argv[1]);
+	}
+	if(argc > 2) {
+		batch = (size_t)atol(argv[2]);
+	}
+	if(argc > 3) {
+		sphere = atoi(argv[3]);
+	}
+	if(min_seconds <= 0.0 || batch == 0 || sphere < 2) {
+		std::cerr << "Usage: " << argv[0] << " [min seconds per benchmark] [batch bodies] [sphere rings and columns]" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Best transform kernel: " << getTransformKernelName(getBestTransformKernel()) << std::endl << std::endl;
+
+	// Matrix products
+	benchmarkMultiply();
+	setTransformKernel(getBestTransformKernel());
+	std::cout << std::endl;
+
+	// Rotation matrices
+	benchmarkRotate();
+	std::cout << std::endl;
+
+	// Single body transforms
+	benchmarkCompose();
+	std::cout << std::endl;
+
+	// Batch transforms
+	std::cout << "Batch of " << batch << " bodies:" << std::endl;
+	benchmarkBatch(batch);
+	benchmarkKepler(batch);
+	setTransformKernel(getBestTransformKernel());
+	std::cout << std::endl;
+
+	// Sphere generation
+	std::cout << "Sphere of " << sphere << " rings x " << sphere << " columns:" << std::endl;
+	bool identical = benchmarkSphere(sphere);
+	setTransformKernel(getBestTransformKernel());
+
+	return identical ? 0 : 1;
+}
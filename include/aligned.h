@@ -0,0 +1,114 @@
+#ifndef ALIGNED_H
+#define ALIGNED_H
+
+// System Headers
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// --------------------------------------------------------------------------------
+// Aligned Array
+// --------------------------------------------------------------------------------
+// Growable contiguous array of plain data (no constructors run) whose storage
+// starts on an ALIGNMENT byte boundary, so columns can be loaded with aligned
+// SIMD instructions and never share a cache line with another column.
+template<typename T>
+class AlignedArray {
+public:
+	// Cache line / AVX-512 alignment
+	static const size_t ALIGNMENT = 64;
+
+	// Constructor
+	AlignedArray() : mBlock(NULL), mData(NULL), mSize(0), mCapacity(0) {}
+	explicit AlignedArray(size_t size) : mBlock(NULL), mData(NULL), mSize(0), mCapacity(0) { resize(size); }
+	~AlignedArray() { free(mBlock); }
+
+	// Copy
+	AlignedArray(const AlignedArray &other) : mBlock(NULL), mData(NULL), mSize(0), mCapacity(0) {
+		resize(other.mSize);
+		if(mSize > 0) {
+			memcpy(mData, other.mData, mSize * sizeof(T));
+		}
+	}
+	AlignedArray& operator=(const AlignedArray &other) {
+		if(this != &other) {
+			resize(other.mSize);
+			if(mSize > 0) {
+				memcpy(mData, other.mData, mSize * sizeof(T));
+			}
+		}
+		return *this;
+	}
+
+	// Capacity
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+
+	// Grow storage to at least capacity elements (contents kept)
+	void reserve(size_t capacity) {
+		if(capacity <= mCapacity) {
+			return;
+		}
+
+		// Over-allocate and align by hand (portable - no aligned_alloc needed)
+		void *block = malloc(capacity * sizeof(T) + ALIGNMENT);
+		if(block == NULL) {
+			throw std::bad_alloc();
+		}
+		T *data = (T*)(((uintptr_t)block + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+
+		// Move contents
+		if(mSize > 0) {
+			memcpy(data, mData, mSize * sizeof(T));
+		}
+		free(mBlock);
+
+		mBlock = block;
+		mData = data;
+		mCapacity = capacity;
+	}
+
+	// Resize (new elements are zeroed)
+	void resize(size_t size) {
+		if(size > mCapacity) {
+			reserve(size > mCapacity * 2 ? size : mCapacity * 2);
+		}
+		if(size > mSize) {
+			memset(mData + mSize, 0, (size - mSize) * sizeof(T));
+		}
+		mSize = size;
+	}
+
+	// Append
+	void push_back(const T &value) {
+		resize(mSize + 1);
+		mData[mSize - 1] = value;
+	}
+
+	void clear() { mSize = 0; }
+
+	// Exchange contents with another array (no copying)
+	void swap(AlignedArray &other) {
+		std::swap(mBlock, other.mBlock);
+		std::swap(mData, other.mData);
+		std::swap(mSize, other.mSize);
+		std::swap(mCapacity, other.mCapacity);
+	}
+
+	// Access
+	T* data() { return mData; }
+	const T* data() const { return mData; }
+	T& operator[](size_t i) { return mData[i]; }
+	const T& operator[](size_t i) const { return mData[i]; }
+private:
+	// Data Members
+	void *mBlock;
+	T *mData;
+	size_t mSize;
+	size_t mCapacity;
+};
+
+#endif // ALIGNED_H
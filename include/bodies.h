@@ -0,0 +1,101 @@
+#ifndef BODIES_H
+#define BODIES_H
+
+// System Headers
+#include <iostream>
+
+// Project Headers
+#include "aligned.h"
+#include "scene_graph.h"
+#include "jobs.h"
+#include "kepler.h"
+
+// --------------------------------------------------------------------------------
+// Body Table
+// --------------------------------------------------------------------------------
+
+// Description of a body when it is added to the table
+struct BodyDesc {
+	const char *texture;    // Surface map
+	float radius;           // World radius
+	OrbitalElements orbit;  // Orbit around the parent (or the origin)
+	float spin_speed;       // Radians per second around own Y axis
+	int parent;             // Index of the body orbited (-1 for none) - must be added first
+};
+
+// Structure-of-arrays store of every body. Each property is its own aligned,
+// contiguous column indexed by body, so per-body passes stream through memory
+// and can be vectorised. Parents always come before their children.
+// Every body owns a scene graph node for its orbit centre - children of that
+// node (moons, rings, stations) follow the body without its spin or scale.
+class BodyTable {
+public:
+	// Number of bodies
+	size_t size() const { return radius.size(); }
+
+	// Reserve space for count bodies
+	void reserve(size_t count);
+
+	// Add a body using texture array layer and a new node in scene (returns its index)
+	size_t add(const BodyDesc &desc, int texture_layer, SceneGraph &scene);
+
+	// Remove all bodies
+	void clear();
+
+	// Properties
+	AlignedArray<float> radius;
+	AlignedArray<float> spin_speed;
+	AlignedArray<int> parent;
+	AlignedArray<int> layer;
+	AlignedArray<int> node;
+
+	// Orbits - elements at t = 0 and the scaled orbit plane basis (see orbitBasis)
+	AlignedArray<float> eccentricity;
+	AlignedArray<float> epoch_anomaly;
+	AlignedArray<float> mean_motion;
+	AlignedArray<float> px, py, pz;
+	AlignedArray<float> qx, qy, qz;
+
+	// State - mean anomaly, position relative to the parent and spin angle at the current step
+	AlignedArray<float> mean_anomaly;
+	AlignedArray<float> x, y, z;
+	AlignedArray<float> spin;
+
+	// Output - column-major model matrix, 16 floats per body
+	AlignedArray<float> model;
+};
+
+// Bodies handed to a job at a time by the functions below
+const size_t BODY_GRAIN = 1024;
+
+// Evaluate orbit positions (solving Kepler's equation) and spin angles at a time
+void evaluateBodies(BodyTable &bodies, double time, JobSystem &jobs);
+
+// Compose every model matrix from the evaluated state, moving each body's
+// scene node and updating the scene
+void updateBodyTransforms(BodyTable &bodies, SceneGraph &scene, JobSystem &jobs);
+
+// Set visible[i] to 1 if the bounding sphere of body i (centre from model, 16 floats
+// per body, and radius) is inside the frustum of a view-projection matrix, else 0
+void cullBodies(const float *model, const float *radius, uint8_t *visible, size_t count, const float viewProjection[16], JobSystem &jobs);
+
+// Level of detail selection
+struct LODSettings {
+	float pixel_error;   // Largest screen-space error allowed (pixels)
+	float min_radius;    // Bodies with a smaller projected radius (pixels) are skipped
+	float hysteresis;    // Margin (fraction) a body must pass before switching to a coarser level or skipping
+};
+
+// Pixels per world unit at a distance of 1 for a perspective projection matrix and viewport height
+float getPixelScale(const float projection[16], int viewport_height);
+
+// Choose the mesh level of every visible body from its projected size: the
+// coarsest level whose error (level_error[l] * projected radius) stays within
+// the pixel budget. level holds the previous choice on entry (-1 for skipped)
+// and the new one on return. Invisible bodies keep their previous level. A
+// pixel error of 0 selects level 0 for every visible body (none are skipped).
+void selectBodyLevels(const float *model, const float *radius, const uint8_t *visible, int *level, size_t count,
+                      const float eye[3], float pixel_scale, const float *level_error, int num_levels,
+                      const LODSettings &settings, JobSystem &jobs);
+
+#endif // BODIES_H
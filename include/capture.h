@@ -0,0 +1,124 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// OpenGL Headers
+#if defined(_WIN32)
+	#include <GL/glew.h>
+	#if defined(GLEW_EGL)
+		#include <GL/eglew.h>
+	#elif defined(GLEW_OSMESA)
+		#define GLAPI extern
+		#include <GL/osmesa.h>
+	#elif defined(_WIN32)
+		#include <GL/wglew.h>
+	#elif !defined(__APPLE__) && !defined(__HAIKU__) || defined(GLEW_APPLE_GLX)
+		#include <GL/glxew.h>
+	#endif
+
+	// OpenGL Headers
+	#define GLFW_INCLUDE_GLCOREARB
+	#include <GLFW/glfw3.h>
+#elif defined(__APPLE__)
+	#define GLFW_INCLUDE_GLCOREARB
+	#include <GLFW/glfw3.h>
+	#include <OpenGL/gl3.h>
+	#include <OpenGL/gl3ext.h>
+		// OpenGL Headers
+	#include <OpenGL/gl3.h>
+#elif defined(__LINUX__)
+    #include <GL/glew.h>
+    #include <GL/glut.h>
+    #include <GLFW/glfw3.h>
+
+#elif defined(__unix__)
+    #include <GL/glew.h>
+    #include <GL/glut.h>
+    #include <GLFW/glfw3.h>
+#endif
+
+// --------------------------------------------------------------------------------
+// Image Writers
+// --------------------------------------------------------------------------------
+
+// Capture file formats
+enum CaptureFormat {
+	CAPTURE_PNG,
+	CAPTURE_PPM,
+	CAPTURE_RAW
+};
+
+// Parse a format name ("png", "ppm" or "raw" - returns false if unknown)
+bool parseCaptureFormat(const std::string &name, CaptureFormat &format);
+
+// Write RGBA pixels (bottom row first, as read from OpenGL) to file
+bool writeImage(const char *filename, CaptureFormat format, const unsigned char *pixels, int width, int height);
+
+// --------------------------------------------------------------------------------
+// Frame Capture
+// --------------------------------------------------------------------------------
+// Reads the framebuffer back through a ring of pixel buffer objects so the copy of
+// frame N completes while frames N+1 and N+2 are rendered, then hands the pixels to
+// a background thread that encodes and writes them to disk.
+class FrameCapture {
+public:
+	// Constructor - files are named <prefix><frame>.<ext>
+	FrameCapture(int width, int height, CaptureFormat format, const std::string &prefix, int ring_size = 3);
+	~FrameCapture();
+
+	// Start an asynchronous readback of the current read framebuffer
+	void capture(unsigned long frame);
+
+	// Collect outstanding readbacks and wait for every file to be written
+	void finish();
+
+	// Frames written so far
+	unsigned long getWritten();
+
+	// Frames that could not be read back or written so far
+	unsigned long getFailed();
+private:
+	// Pending or written frame
+	struct Frame {
+		unsigned long index;
+		std::vector<unsigned char> pixels;
+	};
+
+	// Map the PBO in slot and queue its pixels for writing
+	void collect(int slot);
+
+	// Writer thread
+	void writerLoop();
+
+	// Data Members
+	int mWidth, mHeight;
+	CaptureFormat mFormat;
+	std::string mPrefix;
+
+	// PBO ring (render thread only)
+	std::vector<GLuint> mBuffers;
+	std::vector<GLsync> mFences;
+	std::vector<unsigned long> mFrameIndex;
+	std::vector<bool> mPending;
+	unsigned long mSubmitted;
+
+	// Writer queue (shared)
+	std::mutex mMutex;
+	std::condition_variable mQueueChanged;
+	std::deque<Frame> mQueue;
+	std::vector<std::vector<unsigned char> > mFreeBuffers;
+	unsigned long mWritten;
+	unsigned long mFailed;
+	bool mStop;
+	std::thread mWriter;
+};
+
+#endif // CAPTURE_H
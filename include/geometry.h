@@ -46,6 +46,9 @@
 #include "glm/glm.hpp"
 #include "glm/gtx/string_cast.hpp"
 
+// Project Headers
+#include "jobs.h"
+
 // Create Tetrahedron with Positions and Normals
 void createTetrahedron(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes);
 
@@ -61,7 +64,124 @@ void createTexturedCube(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3>
 // Create Torus with Positions and Normals
 void createTorus(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, float r1, float r2, int sub1, int sub2);
 
+// Create Torus into caller storage - getTorusVertexCount() * 2 vec4 and getTorusTriangleCount() triangles
+void createTorus(glm::vec4 *buffer, glm::ivec3 *indexes, float r1, float r2, int sub1, int sub2);
+
+// Exact size of a torus
+inline int getTorusVertexCount(int sub1, int sub2) { return sub1 * sub2; }
+inline int getTorusTriangleCount(int sub1, int sub2) { return 2 * sub1 * sub2; }
+
 // Create Sphere with Positions and Normals
 void createSphereData(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, float r, int sub1, int sub2);
 
+// Create Sphere into caller storage - getSphereVertexCount() * 3 vec4 and getSphereTriangleCount() triangles
+void createSphereData(glm::vec4 *buffer, glm::ivec3 *indexes, float r, int sub1, int sub2);
+
+// Create Sphere with rows split across the job system (SIMD rows from per ring
+// and column sin/cos tables) - identical bits to the per-vertex float loop for
+// any radius, kernel or thread count.
+// Library only: startup builds the icosphere/cube sphere LOD chains below.
+// transforms_bench times every path and compares it byte for byte with that loop.
+void createSphereData(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, float r, int sub1, int sub2, JobSystem &jobs);
+void createSphereData(glm::vec4 *buffer, glm::ivec3 *indexes, float r, int sub1, int sub2, JobSystem &jobs);
+
+// Exact size of a sphere
+inline int getSphereVertexCount(int sub1, int sub2) { return sub1 * (sub2 + 1); }
+inline int getSphereTriangleCount(int sub1, int sub2) { return 2 * (sub1 - 1) * (sub2 + 1); }
+
+// Level of detail in a chain of meshes sharing one vertex and index buffer.
+// Indexes are absolute (no base vertex needed) and level 0 is the finest.
+struct MeshLevel {
+	int first_vertex;    // First vertex (3 vec4 each - position, normal, UV - or one PackedVertex)
+	int vertices;        // Vertex count
+	int first_triangle;  // First triangle in indexes
+	int triangles;       // Triangle count
+	int first_index;     // First index and index count in the level's IndexBuffer
+	int indices;         // (3 per triangle, fewer as strips)
+	float error;         // Largest gap between the triangles and the sphere, as a fraction of the radius
+};
+
+// Create Icosphere LOD chain with Positions, Normals and UVs - level i is an
+// icosahedron subdivided (num_levels - 1 - i) times (20 * 4^n triangles)
+void createIcosphereLODs(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, float r, int num_levels);
+
+// Create Cube Sphere LOD chain with Positions, Normals and UVs - level i is a
+// cube with subdivisions[i] quads along each edge pushed out onto the sphere (12 * n^2 triangles)
+//
+// Both LOD chains append to the vectors - there is no caller-storage form.
+// Triangles are pushed into storage reserved for the whole chain and each
+// level's vertices are added with one resize once its seam duplicates are known.
+void createCubeSphereLODs(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, float r, const int *subdivisions, int num_levels);
+
+// Index buffer in the narrowest type that holds every index - 16-bit unless an
+// index reaches 0xFFFF. Strips (GL_TRIANGLE_STRIP) are split by the restart
+// index of the type (see primitiveRestartIndex), so draws of them need
+// GL_PRIMITIVE_RESTART enabled and draws of lists need it disabled.
+struct IndexBuffer {
+	GLenum type;                  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum mode;                  // GL_TRIANGLES or GL_TRIANGLE_STRIP
+	std::vector<GLushort> shorts; // 16-bit indexes (type GL_UNSIGNED_SHORT)
+	std::vector<GLuint> ints;     // 32-bit indexes (type GL_UNSIGNED_INT)
+
+	// Index count, size in bytes and data for glBufferData
+	size_t size() const { return type == GL_UNSIGNED_SHORT ? shorts.size() : ints.size(); }
+	size_t bytes() const { return type == GL_UNSIGNED_SHORT ? shorts.size() * sizeof(GLushort) : ints.size() * sizeof(GLuint); }
+	const void *data() const { return type == GL_UNSIGNED_SHORT ? (const void*)shorts.data() : (const void*)ints.data(); }
+
+	// Free the host indexes once uploaded (type and mode stay valid)
+	void release() { std::vector<GLushort>().swap(shorts); std::vector<GLuint>().swap(ints); }
+};
+
+// Restart index ending a strip in a buffer of an index type (the largest index it holds)
+inline GLuint primitiveRestartIndex(GLenum type) {
+	return type == GL_UNSIGNED_BYTE ? 0xFF : (type == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+}
+
+// Build an index buffer from triangles - every level's range is converted (and
+// first_index/indices updated) and strips are built when requested
+void buildIndexBuffer(const std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, bool strips, IndexBuffer &buffer);
+
+// Build a triangle list index buffer in the narrowest type
+void buildIndexBuffer(const std::vector<glm::ivec3> &indexes, IndexBuffer &buffer);
+
+// Post-transform cache statistics - average cache misses per triangle (ACMR)
+// and per vertex (ATVR, 1 is ideal) for a FIFO cache
+struct VertexCacheStats {
+	float acmr;
+	float atvr;
+};
+
+// Simulated FIFO cache size for the statistics
+const int VERTEX_CACHE_SIZE = 16;
+
+// Cache statistics of one level's range of an index buffer (lists or strips)
+VertexCacheStats analyzeVertexCache(const IndexBuffer &buffer, const MeshLevel &level, int cache_size = VERTEX_CACHE_SIZE);
+
+// Optimise every level for the GPU - triangles reordered for the post-transform
+// cache (Forsyth), optionally sorted in clusters that face outwards first
+// (overdraw, convex meshes), then vertices renumbered in first-use order for
+// fetch locality. Buffers hold stride vec4 per vertex, position first.
+void optimizeMesh(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, int stride, bool overdraw);
+
+// Optimise a whole mesh (one level) - e.g. the skybox
+void optimizeMesh(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, int stride, bool overdraw);
+
+// Packed vertex (16 bytes instead of 48) - snorm16 position (meshes must fit
+// in the unit cube), octahedral snorm16 normal and unorm16 UV divided by
+// PACKED_UV_RANGE (seam vertices have u up to 1.5). Decoded in the shaders.
+struct PackedVertex {
+	GLshort position[4];   // xyz, w = 1
+	GLshort normal[2];     // Octahedral encoding
+	GLushort uv[2];
+};
+
+// Largest packed UV coordinate
+const float PACKED_UV_RANGE = 2.0f;
+
+// Pack a buffer of (position, normal, UV) vec4 triples - one PackedVertex each
+void packVertices(const std::vector<glm::vec4> &buffer, std::vector<PackedVertex> &packed);
+
+// Pack vertices into caller storage (e.g. a mapped vertex buffer)
+void packVertices(const glm::vec4 *buffer, size_t vertices, PackedVertex *packed);
+
 #endif // GEOMETRY_H
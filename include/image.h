@@ -57,4 +57,11 @@ GLuint loadTexture2D(const char *filename, int &x, int &y, int &n);
 // Load a CubeMap Texture from file
 GLuint loadTextureCubeMap(const char *filename[6], int &x, int &y, int &n);
 
+// Resample an image to a new size (bilinear)
+void resampleImage(const unsigned char *src, int src_width, int src_height, unsigned char *dst, int dst_width, int dst_height, int n);
+
+// Load a 2D Texture Array from files - every layer is resampled to x by y
+// (0 uses the first image size) and given a full mip chain
+GLuint loadTexture2DArray(const char *filename[], int count, int &x, int &y, int &n, bool flip);
+
 #endif // IMAGE_H
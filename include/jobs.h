@@ -0,0 +1,104 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+// System Headers
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+// Caller deque slots of a job system (shared with the threads holding them)
+struct JobCallerSlots;
+
+// --------------------------------------------------------------------------------
+// Job System
+// --------------------------------------------------------------------------------
+// Work-stealing scheduler. Every thread (workers plus each thread that calls
+// parallelFor, such as the render and simulation threads) owns a deque of
+// jobs - it pushes and pops at the back, idle threads steal from the front of
+// another deque. A parallel-for job splits its range in half, pushing one
+// half, until it is no bigger than the grain, so thieves always take the
+// largest remaining pieces. A caller waiting for its parallel-for only helps
+// with pieces of that parallel-for, so one caller never runs another's work.
+class JobSystem {
+public:
+	// Threads other than the workers that can call parallelFor at once - a
+	// thread's slot is freed when it exits (callers beyond these run their ranges serially)
+	static const int MAX_CALLERS = 4;
+
+	// Constructor - workers < 0 uses one worker per extra hardware thread, 0 runs everything on the caller
+	explicit JobSystem(int workers = -1);
+	~JobSystem();
+
+	// Worker threads (a calling thread also runs pieces of its own jobs while it waits)
+	int getWorkerCount() const { return (int)mWorkers.size(); }
+
+	// Call fn(begin, end) over [0, count) in chunks of at most grain and wait for all of them
+	template<typename F>
+	void parallelFor(size_t count, size_t grain, const F &fn) {
+		run(count, grain, &invoke<F>, &fn);
+	}
+
+private:
+	// Range function
+	typedef void (*RangeFunction)(const void *data, size_t begin, size_t end);
+
+	// Range of a parallel-for
+	struct Job {
+		RangeFunction function;
+		const void *data;
+		size_t begin, end, grain;
+		std::atomic<size_t> *remaining;
+	};
+
+	// Per-thread deque
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	// Call the user's function
+	template<typename F>
+	static void invoke(const void *data, size_t begin, size_t end) {
+		(*(const F*)data)(begin, end);
+	}
+
+	// Run a parallel-for
+	void run(size_t count, size_t grain, RangeFunction function, const void *data);
+
+	// Run a range on the calling thread in chunks of at most grain
+	void runSerial(size_t count, size_t grain, RangeFunction function, const void *data);
+
+	// Split a job down to the grain (pushing halves) then run it
+	void execute(int thread, Job job);
+
+	// Deque of the calling thread (claiming a caller slot - -1 if none are free)
+	int getThreadIndex();
+
+	// Push to / pop from the back of a thread's deque (only pieces counted by remaining, if not NULL)
+	void push(int thread, const Job &job);
+	bool pop(int thread, Job &job, const std::atomic<size_t> *remaining = NULL);
+
+	// Steal from the front of another thread's deque (only pieces counted by remaining, if not NULL)
+	bool steal(int thread, Job &job, const std::atomic<size_t> *remaining = NULL);
+
+	// Worker thread
+	void workerLoop(int thread);
+
+	// Data Members
+	std::vector<Queue*> mQueues;      // 0 to MAX_CALLERS - 1 - callers, then workers
+	std::vector<std::thread> mWorkers;
+	std::shared_ptr<JobCallerSlots> mCallers;
+	unsigned long mSerial;            // Unique per job system (threads remember the one they last ran in)
+	std::atomic<size_t> mQueued;      // Jobs in every deque (counted before they are pushed)
+	std::atomic<int> mSleepers;       // Workers waiting on mWake
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+	bool mStop;
+};
+
+#endif // JOBS_H
@@ -0,0 +1,45 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+// System Headers
+#include <iostream>
+#include <cmath>
+
+// --------------------------------------------------------------------------------
+// Kepler Orbits
+// --------------------------------------------------------------------------------
+// Elliptical orbits from classical orbital elements. The reference plane is the
+// world XZ plane with +Y as its north pole, so a circular orbit with zero
+// inclination, node and periapsis sits at (a cos M, 0, -a sin M).
+
+// Orbital elements of one body (angles in radians)
+struct OrbitalElements {
+	float semi_major;     // a - world units
+	float eccentricity;   // e - 0 (circle) up to but not including 1
+	float inclination;    // i - tilt of the orbit plane from the reference plane
+	float node;           // Omega - longitude of the ascending node
+	float periapsis;      // omega - argument of periapsis (from the node)
+	float mean_anomaly;   // M0 - mean anomaly at t = 0
+	float mean_motion;    // n - radians per second
+};
+
+// Newton/Halley iterations used by the solvers (enough for float precision up to e = 0.95)
+const int KEPLER_ITERATIONS = 3;
+
+// Orbit plane basis scaled by the orbit size, so that for eccentric anomaly E
+//   position = P (cos E - e) + Q sin E
+void orbitBasis(const OrbitalElements &elements, float P[3], float Q[3]);
+
+// Solve Kepler's equation E - e sin(E) = M for the eccentric anomaly E
+// (M wrapped to [-pi, pi], e in [0, 1))
+float solveKepler(float mean_anomaly, float eccentricity);
+
+// Positions of count bodies from their mean anomalies. Every argument is one
+// array per column - P and Q are the orbitBasis vectors. Runs with the kernel
+// selected by setTransformKernel (see transforms.h).
+void solveOrbits(const float *mean_anomaly, const float *eccentricity,
+                 const float *px, const float *py, const float *pz,
+                 const float *qx, const float *qy, const float *qz,
+                 float *x, float *y, float *z, size_t count);
+
+#endif // KEPLER_H
@@ -0,0 +1,166 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+// System Headers
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+// Project Headers
+#include "aligned.h"
+#include "jobs.h"
+
+// --------------------------------------------------------------------------------
+// N-Body System
+// --------------------------------------------------------------------------------
+// Particles moving under their mutual gravity plus a fixed central mass at the
+// origin (the sun). Steps use kick-drift-kick leapfrog, which is symplectic, so
+// orbits keep their energy over long runs. Forces come from a Barnes-Hut tree:
+// every step the particles are sorted by Morton code, which makes each octree
+// cell a contiguous range, and the tree is stored depth-first so a walk is a
+// single loop with no stack. Nearby particles share one walk (per group of at
+// most GROUP_SIZE, or a whole cell at the deepest level) that lists the cells
+// and particles acting on all of them, and the list is then summed for each
+// particle with SIMD. Masses are in units where G = 1.
+class NBodySystem {
+public:
+	// Octree levels (bits per axis of the Morton code)
+	static const int MORTON_LEVELS = 21;
+
+	// Most particles summed directly in a leaf
+	static const int LEAF_SIZE = 8;
+
+	// Most particles sharing one tree walk
+	static const int GROUP_SIZE = 32;
+
+	// Tree levels built serially - the cells below them (up to 8^levels) are built in parallel
+	static const int TOP_LEVELS = 2;
+
+	// Constructor - central mass, Plummer softening length and opening angle (0, 1]
+	NBodySystem(float central_mass = 0.0f, float softening = 0.01f, float theta = 0.5f);
+
+	// Number of particles
+	size_t size() const { return mass.size(); }
+
+	// Reserve space for count particles
+	void reserve(size_t count);
+
+	// Add a particle (returns its index - indices change every step as particles
+	// are re-sorted, id keeps the index it was added at)
+	size_t add(float px, float py, float pz, float pvx, float pvy, float pvz, float pmass);
+
+	// Add count particles on circular orbits around the central mass, spread
+	// uniformly between two radii in the XZ plane and +-thickness/2 in Y
+	void addBelt(size_t count, float inner, float outer, float thickness, float total_mass, unsigned int seed);
+
+	// Remove all particles
+	void clear();
+
+	// Advance by dt seconds (one leapfrog step)
+	void step(float dt, JobSystem &jobs);
+
+	// Compute accelerations for the current positions (step() calls this)
+	void computeAccelerations(JobSystem &jobs);
+
+	// Settings
+	void setTheta(float theta) { mTheta = theta; }
+	float getTheta() const { return mTheta; }
+	float getSoftening() const { return mSoftening; }
+	float getCentralMass() const { return mCentralMass; }
+
+	// Statistics
+	size_t getNodeCount() const { return mNodes.size(); }
+	size_t getGroupCount() const { return mGroups.size(); }
+	double getInteractions() const { return mInteractions; }
+	unsigned long getSteps() const { return mSteps; }
+	double getStepSeconds() const { return mStepSeconds; }
+
+	// Particles
+	AlignedArray<float> x, y, z;
+	AlignedArray<float> vx, vy, vz;
+	AlignedArray<float> ax, ay, az;
+	AlignedArray<float> mass;
+	AlignedArray<uint32_t> id;
+private:
+	// Octree cell, stored depth-first - the first child (if any) follows its
+	// parent and next is the index after the whole subtree (so a cell is a
+	// leaf when next is the following node)
+	struct Node {
+		float x, y, z;   // Centre of mass
+		float mass;
+		float open2;     // Squared distance inside which the cell is opened
+		int next;
+		int begin;       // Particle range
+		int count;
+	};
+
+	// Particles sharing a tree walk - a cell and the box around its particles
+	struct Group {
+		int node;
+		float bounds[6];
+	};
+
+	// Subtree below the top levels, built by one job
+	struct Subtree {
+		AlignedArray<Node> nodes;
+		AlignedArray<Group> groups;
+		float bounds[6];
+	};
+
+	// Cell in the top levels of the tree, in depth-first order - either built
+	// serially from its children or the root of a subtree
+	struct TopCell {
+		size_t begin, end;
+		int level;
+		int parent;    // Index in the top cells (-1 for the root)
+		int subtree;   // Index of its subtree (-1 if built from its children)
+		int node;      // Index in the tree
+	};
+
+	// Sort particles by Morton code
+	void sortParticles(JobSystem &jobs);
+
+	// Build the tree over the sorted particles
+	void buildTree(JobSystem &jobs);
+
+	// List the top cells for sorted particles [begin, end) at a level
+	void planTopCell(size_t begin, size_t end, int level, int parent);
+
+	// Fill in a top cell built from its children (returns the top cell after its subtree)
+	int finishTopCell(int cell, float bounds[6]);
+
+	// Build the subtree for sorted particles [begin, end) at a level into nodes and groups (returns its node)
+	int buildNode(AlignedArray<Node> &nodes, AlignedArray<Group> &groups, size_t begin, size_t end, int level, bool in_group, float bounds[6]) const;
+
+	// Set a node's centre of mass and opening distance from the mass-weighted position sums, mass and bounds
+	void setNodeMass(Node &node, float cx, float cy, float cz, float m, const float bounds[6]) const;
+
+	// Settings
+	float mCentralMass;
+	float mSoftening;
+	float mTheta;
+
+	// Tree
+	AlignedArray<Node> mNodes;
+	AlignedArray<Group> mGroups;
+	std::vector<TopCell> mTopCells;
+	std::vector<Subtree> mSubtrees;
+	AlignedArray<uint64_t> mCodes, mCodesTemp;
+	AlignedArray<uint32_t> mOrder, mOrderTemp;
+	AlignedArray<float> mTemp;
+	AlignedArray<size_t> mHistograms;
+
+	// State
+	bool mAccelerationsValid;
+	unsigned long mSteps;
+	double mStepSeconds;
+	double mInteractions;
+};
+
+// Particles handed to a job at a time by streaming passes (integration, sorting, copies)
+const size_t PARTICLE_GRAIN = 16384;
+
+// Groups handed to a job at a time for force walks
+const size_t GROUP_GRAIN = 8;
+
+#endif // NBODY_H
@@ -0,0 +1,160 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+// System Headers
+#include <iostream>
+#include <vector>
+
+// OpenGL Headers
+#if defined(_WIN32)
+	#include <GL/glew.h>
+	#if defined(GLEW_EGL)
+		#include <GL/eglew.h>
+	#elif defined(GLEW_OSMESA)
+		#define GLAPI extern
+		#include <GL/osmesa.h>
+	#elif defined(_WIN32)
+		#include <GL/wglew.h>
+	#elif !defined(__APPLE__) && !defined(__HAIKU__) || defined(GLEW_APPLE_GLX)
+		#include <GL/glxew.h>
+	#endif
+
+	// OpenGL Headers
+	#define GLFW_INCLUDE_GLCOREARB
+	#include <GLFW/glfw3.h>
+#elif defined(__APPLE__)
+	#define GLFW_INCLUDE_GLCOREARB
+	#include <GLFW/glfw3.h>
+	#include <OpenGL/gl3.h>
+	#include <OpenGL/gl3ext.h>
+		// OpenGL Headers
+	#include <OpenGL/gl3.h>
+#elif defined(__LINUX__)
+    #include <GL/glew.h>
+    #include <GL/glut.h>
+    #include <GLFW/glfw3.h>
+
+#elif defined(__unix__)
+    #include <GL/glew.h>
+    #include <GL/glut.h>
+    #include <GLFW/glfw3.h>
+#endif
+
+// --------------------------------------------------------------------------------
+// Render State
+// --------------------------------------------------------------------------------
+// Shadow copy of the bound GL state. Calls that would not change the current
+// state are skipped and counted. Call invalidate() after any GL call that bypasses
+// this class.
+class RenderState {
+public:
+	// Texture units and targets tracked
+	static const int MAX_TEXTURE_UNITS = 16;
+	static const int NUM_TEXTURE_TARGETS = 3;
+	static const int NUM_CAPABILITIES = 5;
+
+	// Call counters
+	struct Stats {
+		unsigned long issued;
+		unsigned long elided;
+	};
+
+	// Constructor
+	RenderState();
+
+	// Forget the shadow copy (next call of each kind is always issued)
+	void invalidate();
+
+	// State changes
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void activeTexture(GLenum unit);
+	void bindTexture(GLenum target, GLuint texture);
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void primitiveRestartIndex(GLuint index);
+
+	// Counters
+	const Stats& getStats() const { return mStats; }
+	void resetStats();
+private:
+	// Shadow slot for a texture target (-1 if not tracked)
+	static int textureTargetIndex(GLenum target);
+
+	// Shadow slot for a capability (-1 if not tracked)
+	static int capabilityIndex(GLenum cap);
+
+	// Set a tracked capability
+	void setCapability(GLenum cap, bool on);
+
+	// Data Members (each with a flag saying whether the shadow value is known)
+	GLuint mProgram;
+	GLuint mVertexArray;
+	GLenum mActiveTexture;
+	GLuint mTextures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+	int mCapabilities[NUM_CAPABILITIES];
+	GLuint mRestartIndex;
+	bool mProgramValid;
+	bool mVertexArrayValid;
+	bool mActiveTextureValid;
+	bool mRestartIndexValid;
+	bool mTextureValid[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+	Stats mStats;
+};
+
+// --------------------------------------------------------------------------------
+// Draw List
+// --------------------------------------------------------------------------------
+// A single draw and the state it needs
+struct DrawCommand {
+	// Pass (lower passes are always drawn first, e.g. skybox before bodies)
+	int pass;
+
+	// State
+	GLuint program;
+	GLenum texture_target;
+	GLuint texture;
+	GLuint vao;
+	bool depth_test;
+	bool primitive_restart;  // Restart strips at the largest index of type
+
+	// Per-draw uniforms (location -1 to skip)
+	GLint model_location;
+	GLfloat model[16];
+	GLint layer_location;
+	GLfloat layer;
+
+	// Draw (type 0 draws count vertices in order - no element buffer)
+	GLenum mode;
+	GLint first;         // First index (or vertex when type is 0)
+	GLsizei count;
+	GLenum type;
+	GLsizei instances;
+};
+
+// Collects draws for a frame and issues them sorted by pass -> program -> texture -> VAO
+class DrawList {
+public:
+	// Start a new frame
+	void clear() { mCommands.clear(); }
+
+	// Queue a draw
+	void submit(const DrawCommand &command) { mCommands.push_back(command); }
+
+	// Sort queued draws to minimise state changes
+	void sort();
+
+	// Issue queued draws through the state tracker (texture unit 0)
+	void execute(RenderState &state) const;
+
+	// Number of queued draws
+	size_t size() const { return mCommands.size(); }
+private:
+	// Data Members
+	std::vector<DrawCommand> mCommands;
+};
+
+// Make a draw command with no per-draw uniforms
+DrawCommand makeDrawCommand(int pass, GLuint program, GLenum texture_target, GLuint texture, GLuint vao, GLsizei count);
+
+#endif // RENDER_STATE_H
@@ -0,0 +1,76 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+// System Headers
+#include <iostream>
+#include <stdint.h>
+
+// Project Headers
+#include "aligned.h"
+#include "transforms.h"
+
+// --------------------------------------------------------------------------------
+// Scene Graph
+// --------------------------------------------------------------------------------
+// Flat transform hierarchy. Nodes live in arrays indexed by node and every
+// parent comes before its children (enforced by addNode), so world matrices
+// are propagated in one linear pass with no pointer chasing:
+//   world[i] = world[parent[i]] * local[i]
+// Only nodes whose local matrix changed, or whose parent's world changed,
+// are recomputed.
+class SceneGraph {
+public:
+	// Node returned for an invalid parent
+	static const int INVALID_NODE = -1;
+
+	// Constructor
+	SceneGraph() : mUpdated(0) {}
+
+	// Number of nodes
+	size_t size() const { return mParent.size(); }
+
+	// Reserve space for count nodes
+	void reserve(size_t count);
+
+	// Add a node under parent (-1 for a root) with an identity local matrix
+	int addNode(int parent);
+
+	// Remove all nodes
+	void clear();
+
+	// Parent of a node (-1 for a root)
+	int getParent(int node) const { return mParent[node]; }
+
+	// Set the local matrix (marks the node dirty)
+	void setLocal(int node, const float local[16]);
+
+	// Set the local matrix to a translation (marks the node dirty if it changed)
+	void setLocalTranslation(int node, float x, float y, float z);
+
+	// Local matrix - call markDirty after writing to it directly
+	float *getLocal(int node) { return mLocal[node].m; }
+	const float *getLocal(int node) const { return mLocal[node].m; }
+
+	// Flag a node for update
+	void markDirty(int node) { mDirty[node] = 1; }
+
+	// World matrix (valid after update)
+	const float *getWorld(int node) const { return mWorld[node].m; }
+
+	// Recompute the world matrix of every dirty node and its descendants
+	// (returns the number of world matrices recomputed)
+	size_t update();
+
+	// World matrices recomputed by the last update
+	size_t getUpdated() const { return mUpdated; }
+
+private:
+	// Data Members
+	AlignedArray<int> mParent;
+	AlignedArray<uint8_t> mDirty;
+	AlignedArray<Matrix44> mLocal;
+	AlignedArray<Matrix44> mWorld;
+	size_t mUpdated;
+};
+
+#endif // SCENE_GRAPH_H
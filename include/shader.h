@@ -4,6 +4,8 @@
 // System Headers
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <map>
 
 // OpenGL Headers
 #if defined(_WIN32)
@@ -59,6 +61,64 @@ GLuint loadShader(GLuint type, const char *filename);
 // Load and compiler program from source files
 GLuint loadProgram(const char *vert_file, const char *ctrl_file, const char *eval_file, const char *geom_file, const char *frag_file);
 
+// Create a uniform buffer of size bytes attached to a uniform block binding point
+GLuint createUniformBuffer(GLsizeiptr size, GLuint binding);
+
+// --------------------------------------------------------------------------------
+// Program Wrapper
+// --------------------------------------------------------------------------------
+
+// Active uniform (reflected once at link time)
+struct Uniform {
+	GLint location;
+	GLenum type;
+	GLint size;
+};
+
+// GLSL program with a reflected table of its active uniforms. Look locations up
+// once with getUniformLocation() and pass them to the setters in the render loop.
+class Program {
+public:
+	// Constructor
+	Program();
+	Program(const char *vert_file, const char *ctrl_file, const char *eval_file, const char *geom_file, const char *frag_file);
+
+	// Load, link and reflect program (returns false on error)
+	bool load(const char *vert_file, const char *ctrl_file, const char *eval_file, const char *geom_file, const char *frag_file);
+
+	// Delete program
+	void destroy();
+
+	// Program handle
+	GLuint id() const { return mProgram; }
+
+	// Bind program
+	void use() const { glUseProgram(mProgram); }
+
+	// Attach a uniform block to a binding point (returns false if the block is not active)
+	bool bindUniformBlock(const char *name, GLuint binding) const;
+
+	// Reflected uniforms (no GL calls - returns -1 / NULL if not active)
+	GLint getUniformLocation(const std::string &name) const;
+	const Uniform* getUniform(const std::string &name) const;
+	const std::map<std::string, Uniform>& getUniforms() const { return mUniforms; }
+
+	// Typed setters (program must be in use)
+	void setInt(GLint location, GLint v) const             { glUniform1i(location, v); }
+	void setFloat(GLint location, GLfloat v) const         { glUniform1f(location, v); }
+	void setVec3(GLint location, const GLfloat *v) const   { glUniform3fv(location, 1, v); }
+	void setVec4(GLint location, const GLfloat *v) const   { glUniform4fv(location, 1, v); }
+	void setMat4(GLint location, const GLfloat *m, GLsizei count = 1) const { glUniformMatrix4fv(location, count, GL_FALSE, m); }
+
+private:
+	// Query active uniforms
+	void reflect();
+
+	// Data Members
+	GLuint mProgram;
+	std::map<std::string, Uniform> mUniforms;
+};
+
 // --------------------------------------------------------------------------------
 
 #endif // SHADER_H
@@ -0,0 +1,97 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// System Headers
+#include <cmath>
+
+// --------------------------------------------------------------------------------
+// SIMD Helpers
+// --------------------------------------------------------------------------------
+// Platform detection and vector maths shared by the SIMD kernels in
+// transforms.cpp and kepler.cpp. Kernels are chosen at run time through
+// getTransformKernel() (see transforms.h).
+
+// x86 kernels need GCC/Clang target attributes and x86 intrinsics
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__)
+	#define SIMD_X86
+	#include <immintrin.h>
+#endif
+
+// NEON is always present when the compiler targets it
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+#if defined(SIMD_X86)
+// sin/cos polynomial constants (Cephes single precision, |x| <= pi/4)
+// pi/2 split in three so j*DP1 and j*DP2 are exact
+#define SINCOS_DP1  1.5703125f
+#define SINCOS_DP2  4.837512969970703125e-4f
+#define SINCOS_DP3  7.54978995489188216e-8f
+#define SINCOS_S1  -1.6666654611e-1f
+#define SINCOS_S2   8.3321608736e-3f
+#define SINCOS_S3  -1.9515295891e-4f
+#define SINCOS_C1   4.166664568298827e-2f
+#define SINCOS_C2  -1.388731625493765e-3f
+#define SINCOS_C3   2.443315711809948e-5f
+
+// Sine and cosine of 4 angles
+static inline void sincos4(__m128 x, __m128 &sin_x, __m128 &cos_x) {
+	// Quadrant j = round(x / (pi/2)) and remainder x - j*(pi/2) in [-pi/4, pi/4]
+	__m128i j = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps((float)(2.0 / M_PI))));
+	__m128 fj = _mm_cvtepi32_ps(j);
+	x = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(SINCOS_DP1)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(SINCOS_DP2)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(SINCOS_DP3)));
+
+	// Polynomials
+	__m128 x2 = _mm_mul_ps(x, x);
+	__m128 s = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(SINCOS_S3)), _mm_set1_ps(SINCOS_S2));
+	s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(SINCOS_S1));
+	s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, x2), x), x);
+	__m128 c = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(SINCOS_C3)), _mm_set1_ps(SINCOS_C2));
+	c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(SINCOS_C1));
+	c = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(c, x2), x2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x2, _mm_set1_ps(0.5f))));
+
+	// Odd quadrants swap sin and cos
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	sin_x = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+	cos_x = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+	// Quadrants 2,3 negate sin and quadrants 1,2 negate cos
+	__m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), 30));
+	__m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+	sin_x = _mm_xor_ps(sin_x, sin_sign);
+	cos_x = _mm_xor_ps(cos_x, cos_sign);
+}
+
+// Sine and cosine of 8 angles (same method as sincos4)
+__attribute__((target("avx2")))
+static inline void sincos8(__m256 x, __m256 &sin_x, __m256 &cos_x) {
+	__m256i j = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps((float)(2.0 / M_PI))));
+	__m256 fj = _mm256_cvtepi32_ps(j);
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fj, _mm256_set1_ps(SINCOS_DP1)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fj, _mm256_set1_ps(SINCOS_DP2)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fj, _mm256_set1_ps(SINCOS_DP3)));
+
+	__m256 x2 = _mm256_mul_ps(x, x);
+	__m256 s = _mm256_add_ps(_mm256_mul_ps(x2, _mm256_set1_ps(SINCOS_S3)), _mm256_set1_ps(SINCOS_S2));
+	s = _mm256_add_ps(_mm256_mul_ps(s, x2), _mm256_set1_ps(SINCOS_S1));
+	s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, x2), x), x);
+	__m256 c = _mm256_add_ps(_mm256_mul_ps(x2, _mm256_set1_ps(SINCOS_C3)), _mm256_set1_ps(SINCOS_C2));
+	c = _mm256_add_ps(_mm256_mul_ps(c, x2), _mm256_set1_ps(SINCOS_C1));
+	c = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(c, x2), x2), _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(x2, _mm256_set1_ps(0.5f))));
+
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	sin_x = _mm256_blendv_ps(s, c, swap);
+	cos_x = _mm256_blendv_ps(c, s, swap);
+
+	__m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), 30));
+	__m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+	sin_x = _mm256_xor_ps(sin_x, sin_sign);
+	cos_x = _mm256_xor_ps(cos_x, cos_sign);
+}
+#endif // SIMD_X86
+
+#endif // SIMD_H
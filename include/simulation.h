@@ -0,0 +1,58 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// System Headers
+#include <iostream>
+#include <cmath>
+#include <atomic>
+
+// --------------------------------------------------------------------------------
+// Simulation Clock
+// --------------------------------------------------------------------------------
+// Fixed-timestep clock. Real (wall) time is scaled, added to an accumulator and
+// consumed in whole steps of getStep() seconds. Simulation time is derived from
+// the step count, so a run with the same steps always gives the same results no
+// matter the frame rate. The renderer interpolates between the last two states
+// handed over by the simulation (see SimulationThread::getAlpha).
+class SimulationClock {
+public:
+	// Constructor - step in simulation seconds
+	SimulationClock(double step = 1.0 / 120.0);
+
+	// Add real elapsed seconds and return the number of steps to simulate
+	unsigned long advance(double real_dt);
+
+	// Fixed step size (simulation seconds)
+	double getStep() const { return mStep; }
+
+	// Steps taken since the start
+	unsigned long getStepCount() const { return mStepCount; }
+
+	// Simulation time at a given step / the latest step
+	double getTimeAt(unsigned long step) const { return step * mStep; }
+	double getTime() const { return getTimeAt(mStepCount); }
+
+	// Fraction [0, 1) of a step between the latest step and the current moment
+	double getAlpha() const { return mAccumulator / mStep; }
+
+	// Simulation seconds per real second (warp) - safe to set from another thread
+	void setTimeScale(double scale) { mTimeScale = scale; }
+	double getTimeScale() const { return mTimeScale; }
+
+	// Pause (time scale is kept) - safe to set from another thread
+	void setPaused(bool paused) { mPaused = paused; }
+	bool isPaused() const { return mPaused; }
+
+	// Largest real frame time accepted (longer frames, e.g. a debugger break, are clamped)
+	void setMaxFrameTime(double seconds) { mMaxFrameTime = seconds; }
+private:
+	// Data Members
+	double mStep;
+	double mAccumulator;
+	std::atomic<double> mTimeScale;
+	double mMaxFrameTime;
+	unsigned long mStepCount;
+	std::atomic<bool> mPaused;
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1,121 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+// System Headers
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Project Headers
+#include "simulation.h"
+#include "bodies.h"
+#include "nbody.h"
+#include "scene_graph.h"
+#include "jobs.h"
+#include "aligned.h"
+#include "triple_buffer.h"
+
+// --------------------------------------------------------------------------------
+// Simulation Thread
+// --------------------------------------------------------------------------------
+
+// Everything the renderer needs from one simulation step, with the state of
+// the step published before it so the renderer can interpolate between them
+struct SceneSnapshot {
+	AlignedArray<float> x, y, z;            // World centre per body
+	AlignedArray<float> previous_x;         // World centres at the previous snapshot
+	AlignedArray<float> previous_y;
+	AlignedArray<float> previous_z;
+	AlignedArray<float> previous_spin;      // Spin angle per body at the previous snapshot
+	AlignedArray<float> spin_speed;         // Radians per simulation second per body
+	AlignedArray<float> radius;             // Bounding sphere radius per body
+	AlignedArray<int> layer;                // Texture array layer per body
+	AlignedArray<float> particles;          // N-body particle positions, 3 floats per particle (in the order added)
+	AlignedArray<float> previous_particles; // Particle positions at the previous snapshot
+	double time;                            // Simulation time
+	double previous_time;                   // Simulation time of the previous snapshot
+	double leftover;                        // Simulation seconds accumulated past time when published
+	unsigned long step;                     // Simulation step
+	std::chrono::steady_clock::time_point published; // Real time of publishing
+
+	SceneSnapshot() : time(0.0), previous_time(0.0), leftover(0.0), step(0) {}
+};
+
+// Runs the simulation clock, orbit evaluation, body transforms and optional
+// N-body particles - on its own thread once started, or synchronously through
+// advance() - and hands each completed step to the renderer through a triple
+// buffer of snapshots. The bodies, particles, scene and clock belong to the
+// simulation while it runs (the clock's time scale and pause may still be set
+// from other threads).
+class SimulationThread {
+public:
+	// N-body steps run per advance at most - every one is a whole fixed step,
+	// and steps due beyond them are dropped for the particles only, so under
+	// warp or load the particles fall behind instead of stretching the leapfrog
+	// step (orbits and the clock keep up)
+	static const unsigned long MAX_PARTICLE_STEPS = 4;
+
+	// Constructor - publishes the state at time 0 (particles may be NULL)
+	SimulationThread(SimulationClock &clock, BodyTable &bodies, SceneGraph &scene, JobSystem &jobs, NBodySystem *particles = NULL);
+	~SimulationThread();
+
+	// Run the simulation on its own thread in real time
+	void start();
+
+	// Stop and join the thread
+	void stop();
+
+	// Check if the thread is running
+	bool isRunning() const { return mThread.joinable(); }
+
+	// Advance by real seconds and publish a snapshot if a step ran (only when not started)
+	void advance(double real_dt);
+
+	// Renderer - latest complete snapshot
+	const SceneSnapshot &acquire();
+
+	// Renderer - fraction [0, 1] of the way from a snapshot's previous state to
+	// its latest one to draw now. The renderer stays one snapshot behind, moving
+	// through it with the clock's time scale as real time passes since it was
+	// published (only the leftover time counts when not started, so headless
+	// runs stay repeatable).
+	double getAlpha(const SceneSnapshot &snapshot) const;
+
+	// Snapshots published so far
+	unsigned long getPublished() const { return mPublished; }
+
+	// Simulation seconds the particles skipped to stay within MAX_PARTICLE_STEPS (read once stopped)
+	double getDroppedParticleTime() const { return mDroppedParticleTime; }
+
+private:
+	// Copy the bodies into the back snapshot and publish it
+	void publish();
+
+	// Thread body
+	void threadLoop();
+
+	// Data Members
+	SimulationClock &mClock;
+	BodyTable &mBodies;
+	SceneGraph &mScene;
+	JobSystem &mJobs;
+	NBodySystem *mParticles;
+	TripleBuffer<SceneSnapshot> mSnapshots;
+	AlignedArray<float> mLastX, mLastY, mLastZ; // State of the last snapshot published
+	AlignedArray<float> mLastSpin;
+	AlignedArray<float> mLastParticles;
+	double mLastTime;
+	double mDroppedParticleTime;
+	std::atomic<unsigned long> mPublished;
+	std::atomic<bool> mStop;
+	std::thread mThread;
+};
+
+// Renderer - compose every body's model matrix part way (alpha) from a
+// snapshot's previous state to its latest one. Centres are blended and spin
+// angles advanced at each body's spin speed, then the matrices are composed,
+// so bodies keep their shape however far apart the two steps are.
+void interpolateBodies(const SceneSnapshot &snapshot, float alpha, float *model, JobSystem &jobs);
+
+#endif // SIMULATION_THREAD_H
@@ -44,63 +44,236 @@
 // --------------------------------------------------------------------------------
 // Transform Functions
 // --------------------------------------------------------------------------------
+// Matrices are column-major T[16], vectors T[3] or T[4]. Every function is a
+// header template (float or double) so calls inline and, where no trig or
+// square root is involved, are constexpr and fold to constants.
 
 // Create an identity matrix
-void identity(float I[16]);
+template<typename T>
+constexpr void identity(T I[16]) {
+	I[0]  = 1;  I[4]  = 0;  I[8]  = 0;  I[12] = 0;
+	I[1]  = 0;  I[5]  = 1;  I[9]  = 0;  I[13] = 0;
+	I[2]  = 0;  I[6]  = 0;  I[10] = 1;  I[14] = 0;
+	I[3]  = 0;  I[7]  = 0;  I[11] = 0;  I[15] = 1;
+}
 
 // Create a translation matrix with (x,y,z)
-void translate(float tx, float ty, float tz, float T[16]);
+template<typename T>
+constexpr void translate(T tx, T ty, T tz, T M[16]) {
+	M[0]  = 1;  M[4]  = 0;  M[8]  = 0;  M[12] = tx;
+	M[1]  = 0;  M[5]  = 1;  M[9]  = 0;  M[13] = ty;
+	M[2]  = 0;  M[6]  = 0;  M[10] = 1;  M[14] = tz;
+	M[3]  = 0;  M[7]  = 0;  M[11] = 0;  M[15] = 1;
+}
 
 // Create a rotation matrix around the X-axis
-void rotateX(float theta, float Rx[16]);
+template<typename T>
+inline void rotateX(T theta, T Rx[16]) {
+	// Calculate sin(theta) and cos(theta)
+	T sinTheta = std::sin(theta);
+	T cosTheta = std::cos(theta);
+
+	Rx[0]  = 1;  Rx[4]  = 0;         Rx[8]  =  0;         Rx[12] = 0;
+	Rx[1]  = 0;  Rx[5]  = cosTheta;  Rx[9]  = -sinTheta;  Rx[13] = 0;
+	Rx[2]  = 0;  Rx[6]  = sinTheta;  Rx[10] =  cosTheta;  Rx[14] = 0;
+	Rx[3]  = 0;  Rx[7]  = 0;         Rx[11] =  0;         Rx[15] = 1;
+}
 
 // Create a rotation matrix around the Y-axis
-void rotateY(float theta, float Ry[16]);
+template<typename T>
+inline void rotateY(T theta, T Ry[16]) {
+	// Calculate sin(theta) and cos(theta)
+	T sinTheta = std::sin(theta);
+	T cosTheta = std::cos(theta);
+
+	Ry[0]  =  cosTheta;  Ry[4]  = 0;  Ry[8]  = sinTheta;  Ry[12] = 0;
+	Ry[1]  =  0;         Ry[5]  = 1;  Ry[9]  = 0;         Ry[13] = 0;
+	Ry[2]  = -sinTheta;  Ry[6]  = 0;  Ry[10] = cosTheta;  Ry[14] = 0;
+	Ry[3]  =  0;         Ry[7]  = 0;  Ry[11] = 0;         Ry[15] = 1;
+}
 
 // Create a rotation matrix around the Z-axis
-void rotateZ(float theta, float Rz[16]);
+template<typename T>
+inline void rotateZ(T theta, T Rz[16]) {
+	// Calculate sin(theta) and cos(theta)
+	T sinTheta = std::sin(theta);
+	T cosTheta = std::cos(theta);
+
+	Rz[0]  = cosTheta;  Rz[4]  = -sinTheta;  Rz[8]  = 0;  Rz[12] = 0;
+	Rz[1]  = sinTheta;  Rz[5]  =  cosTheta;  Rz[9]  = 0;  Rz[13] = 0;
+	Rz[2]  = 0;         Rz[6]  =  0;         Rz[10] = 1;  Rz[14] = 0;
+	Rz[3]  = 0;         Rz[7]  =  0;         Rz[11] = 0;  Rz[15] = 1;
+}
 
 // Create a rotation matrix around arbitrary axis (rx, ry, rz)
-void rotate(float theta, float rx, float ry, float rz, float R[16]);
+template<typename T>
+inline void rotate(T theta, T rx, T ry, T rz, T R[16]) {
+	// Calculate sin(theta) and cos(theta)
+	T sinTheta = std::sin(theta);
+	T cosTheta = std::cos(theta);
+
+	// Unit axis
+	T l = std::sqrt(rx*rx + ry*ry + rz*rz);
+	rx /= l;
+	ry /= l;
+	rz /= l;
+
+	R[0]  = cosTheta + (1-cosTheta)*rx*rx;     R[4]  = (1-cosTheta)*rx*ry - rz*sinTheta;  R[8]  = (1-cosTheta)*rx*rz + ry*sinTheta;  R[12] = 0;
+	R[1]  = (1-cosTheta)*rx*ry + rz*sinTheta;  R[5]  = cosTheta + (1-cosTheta)*ry*ry;     R[9]  = (1-cosTheta)*ry*rz - rx*sinTheta;  R[13] = 0;
+	R[2]  = (1-cosTheta)*rx*rz - ry*sinTheta;  R[6]  = (1-cosTheta)*ry*rz + rx*sinTheta;  R[10] = cosTheta + (1-cosTheta)*rz*rz;     R[14] = 0;
+	R[3]  = 0;                                 R[7]  = 0;                                 R[11] = 0;                                 R[15] = 1;
+}
 
 // Create a scale matrix
-void scale(float sx, float sy, float sz, float S[16]);
+template<typename T>
+constexpr void scale(T sx, T sy, T sz, T S[16]) {
+	S[0]  = sx;  S[4]  = 0;   S[8]  = 0;   S[12] = 0;
+	S[1]  = 0;   S[5]  = sy;  S[9]  = 0;   S[13] = 0;
+	S[2]  = 0;   S[6]  = 0;   S[10] = sz;  S[14] = 0;
+	S[3]  = 0;   S[7]  = 0;   S[11] = 0;   S[15] = 1;
+}
+
+// Multiply matrix a * b to give c (c must not alias a or b)
+template<typename T>
+constexpr void multiply44(const T a[16], const T b[16], T c[16]) {
+	// Multiply each row of A with each column of B to give C
+	for(int col = 0; col < 16; col += 4) {
+		for(int row = 0; row < 4; row++) {
+			c[col + row] = a[row]*b[col] + a[row + 4]*b[col + 1] + a[row + 8]*b[col + 2] + a[row + 12]*b[col + 3];
+		}
+	}
+}
+
+// 16-byte aligned column-major 4x4 matrix
+struct alignas(16) Matrix44 {
+	float m[16];
+};
 
-// Multiply matrix a * b to give c
-void multiply44(float a[16], float b[16], float c[16]);
+// Multiply matrix a * b to give c with the selected kernel (c may alias a or b)
+void multiply44(const Matrix44 &a, const Matrix44 &b, Matrix44 &c);
 
 // Multiply a vector by a scalar
-void multiply3(float s, float u[3], float v[3]);
+template<typename T>
+constexpr void multiply3(T s, const T u[3], T v[3]) {
+	v[0] = s * u[0];
+	v[1] = s * u[1];
+	v[2] = s * u[2];
+}
 
 // Multiply a vector by a scalar
-void multiply4(float s, float u[4], float v[4]);
+template<typename T>
+constexpr void multiply4(T s, const T u[4], T v[4]) {
+	v[0] = s * u[0];
+	v[1] = s * u[1];
+	v[2] = s * u[2];
+	v[3] = s * u[3];
+}
+
+// Calculate the dot product of two vectors
+template<typename T>
+constexpr T dot_product3(const T a[3], const T b[3]) {
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Calculate the dot product of two vectors
+template<typename T>
+constexpr T dot_product4(const T a[4], const T b[4]) {
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+}
 
 // Calculate the length of a vector
-float length3(float v[3]);
+template<typename T>
+inline T length3(const T v[3]) {
+	return std::sqrt(dot_product3(v, v));
+}
 
 // Calculate the length of a vector
-float length4(float v[4]);
+template<typename T>
+inline T length4(const T v[4]) {
+	return std::sqrt(dot_product4(v, v));
+}
 
-// Normalize a vector
-void normalize(float v[3], float u[3]);
+// Normalize a vector (u may alias v)
+template<typename T>
+inline void normalize(const T v[3], T u[3]) {
+	multiply3(1 / length3(v), v, u);
+}
 
-// Calculate the cross product of two vectors
-void cross_product(float a[3], float b[3], float c[3]);
+// Calculate the cross product of two vectors (c must not alias a or b)
+template<typename T>
+constexpr void cross_product(const T a[3], const T b[3], T c[3]) {
+	c[0] = a[1]*b[2] - a[2]*b[1];
+	c[1] = a[2]*b[0] - a[0]*b[2];
+	c[2] = a[0]*b[1] - a[1]*b[0];
+}
 
-// Calculate the dot product of two vectors
-float dot_product3(float a[3], float b[3]);
+// View Transform - forwards and up must be unit vectors
+template<typename T>
+inline void view(const T p[4], const T f[3], const T u[3], T V[16]) {
+	// Right (side) and true up vectors
+	T s[3], t[3];
+	cross_product(f, u, s);
+	normalize(s, s);
+	cross_product(s, f, t);
 
-// Calculate the dot product of two vectors
-float dot_product4(float a[4], float b[4]);
+	// Rotate the world into camera axes, then move the camera to the origin
+	V[0]  =  s[0];  V[4]  =  s[1];  V[8]  =  s[2];  V[12] = -dot_product3(s, p);
+	V[1]  =  t[0];  V[5]  =  t[1];  V[9]  =  t[2];  V[13] = -dot_product3(t, p);
+	V[2]  = -f[0];  V[6]  = -f[1];  V[10] = -f[2];  V[14] =  dot_product3(f, p);
+	V[3]  =  0;     V[7]  =  0;     V[11] =  0;     V[15] =  1;
+}
 
-// View Transform - forwards and up must be unit vectors
-void view(float p[4], float f[3], float u[3], float V[16]);
+// Create an Orthographic Projection matrix (centred on the view axis)
+template<typename T>
+constexpr void orthographic(T width, T height, T near1, T far1, T matrix[16]) {
+	matrix[0]  = 2 / width;  matrix[4]  = 0;           matrix[8]  = 0;                     matrix[12] = 0;
+	matrix[1]  = 0;          matrix[5]  = 2 / height;  matrix[9]  = 0;                     matrix[13] = 0;
+	matrix[2]  = 0;          matrix[6]  = 0;           matrix[10] = -2 / (far1 - near1);   matrix[14] = -(far1 + near1) / (far1 - near1);
+	matrix[3]  = 0;          matrix[7]  = 0;           matrix[11] = 0;                     matrix[15] = 1;
+}
+
+// Create a Perspective Projection matrix (fov - vertical field of view in radians)
+template<typename T>
+inline void perspective(T aspect, T fov, T near1, T far1, T matrix[16]) {
+	// Focal length
+	T f = 1 / std::tan(fov / 2);
+
+	matrix[0]  = f / aspect;  matrix[4]  = 0;  matrix[8]  = 0;                                  matrix[12] = 0;
+	matrix[1]  = 0;           matrix[5]  = f;  matrix[9]  = 0;                                  matrix[13] = 0;
+	matrix[2]  = 0;           matrix[6]  = 0;  matrix[10] = (far1 + near1) / (near1 - far1);    matrix[14] = 2 * far1 * near1 / (near1 - far1);
+	matrix[3]  = 0;           matrix[7]  = 0;  matrix[11] = -1;                                 matrix[15] = 0;
+}
+
+// --------------------------------------------------------------------------------
+// SIMD Transforms
+// --------------------------------------------------------------------------------
+
+// Instruction set used by the SIMD transform functions
+enum TransformKernel {
+	TRANSFORM_SCALAR,   // Plain C++ (reference)
+	TRANSFORM_SSE2,     // x86 - 4 lanes
+	TRANSFORM_AVX2,     // x86 - 8 lanes
+	TRANSFORM_NEON      // ARM - 4 lanes
+};
+
+// Best kernel supported by this CPU
+TransformKernel getBestTransformKernel();
+
+// Check if this CPU can run a kernel
+bool isTransformKernelSupported(TransformKernel kernel);
+
+// Kernel used by the SIMD functions (defaults to the best supported)
+TransformKernel getTransformKernel();
+
+// Select the kernel used by the SIMD functions (falls back if unsupported)
+void setTransformKernel(TransformKernel kernel);
 
-// Create an Orthographic Projection matrix
-void orthographic(float width, float height, float near1, float far1, float matrix[16]);
+// Name of a kernel
+const char *getTransformKernelName(TransformKernel kernel);
 
-// Create a Perspective Projection matrix
-void perspective(float aspect, float fov, float near1, float far1, float matrix[16]);
+// Compose model[i] = translate(x[i],y[i],z[i]) * rotateY(spin[i]) * scale(radius[i])
+// for count bodies. Inputs are one array per parameter, output is 16 floats per body.
+void composeBodyTransforms(const float *x, const float *y, const float *z, const float *spin, const float *radius, float *model, size_t count);
 
 // --------------------------------------------------------------------------------
 
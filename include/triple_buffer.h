@@ -0,0 +1,53 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+// System Headers
+#include <atomic>
+
+// --------------------------------------------------------------------------------
+// Triple Buffer
+// --------------------------------------------------------------------------------
+// Lock-free single writer / single reader hand-off of whole values. The writer
+// fills the back slot and publishes it by swapping it with the middle slot; the
+// reader takes the middle slot by swapping it with the front slot. Neither side
+// ever waits, the reader always gets the latest complete value, and values
+// published faster than they are read are simply dropped.
+template<typename T>
+class TripleBuffer {
+public:
+	// Constructor
+	TripleBuffer() : mMiddle(1), mBack(0), mFront(2) {}
+
+	// Writer - slot to fill
+	T &getBack() { return mSlots[mBack]; }
+
+	// Writer - make the back slot the latest value (and take the old middle slot to fill next)
+	void publish() {
+		mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Reader - take the latest value if one was published since the last call (returns true if so)
+	bool acquire() {
+		if(!(mMiddle.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+		mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// Reader - latest value taken by acquire
+	const T &getFront() const { return mSlots[mFront]; }
+
+private:
+	// Middle slot index bits and the flag set when it holds an unread value
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	// Data Members
+	T mSlots[3];
+	std::atomic<int> mMiddle;   // Shared
+	int mBack;                  // Writer only
+	int mFront;                 // Reader only
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -47,4 +47,23 @@
 // Create a GLFW Window
 GLFWwindow* createWindow(int width, int height, const char *title, int major = 3, int minor = 2, GLFWmonitor *monitor = NULL, GLFWwindow *share = NULL);
 
+// --------------------------------------------------------------------------------
+// Headless Functions
+// --------------------------------------------------------------------------------
+
+// Offscreen OpenGL context (EGL handles kept opaque so EGL is not needed here)
+struct HeadlessContext {
+	void *display;
+	void *context;
+};
+
+// Create a surfaceless EGL context (no window or display server) and make it current
+bool createHeadlessContext(HeadlessContext &headless, int major = 3, int minor = 2);
+
+// Release a headless context
+void destroyHeadlessContext(HeadlessContext &headless);
+
+// Create a framebuffer object with colour and depth renderbuffers (returns 0 on error)
+GLuint createFramebuffer(int width, int height, GLuint &colour, GLuint &depth);
+
 #endif // UTILS_H
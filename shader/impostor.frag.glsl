@@ -0,0 +1,94 @@
+// OpenGL 4.0
+#version 400
+
+// Input from Vertex Shader
+in vec4 frag_Light_Direction;
+in float frag_Layer;
+
+// Per-frame state (shared by every program - see FrameData in main.cpp)
+layout(std140) uniform FrameData {
+	mat4 u_View;
+	mat4 u_Projection;
+	mat4 u_Orientation;
+	vec4 u_Light_Position;
+	float u_Time;
+};
+
+//get texture map (one layer per body)
+uniform sampler2DArray u_texture_Map;
+
+// Layer drawn unlit (the sun)
+uniform float u_Emissive_Layer = 0.0f;
+
+// Colour of impostors without a layer
+uniform vec4 u_Rock_Colour = vec4(0.45f, 0.4f, 0.35f, 1.0f);
+
+// Output from Fragment Shader
+out vec4 pixel_Colour;
+
+uniform vec4 Ia = vec4(0.02f, 0.02f, 0.02f, 1.0f);
+uniform vec4 Id = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+uniform vec4 Is = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+vec4 Ka;
+vec4 Kd;
+vec4 Ks;
+uniform float a = 21.264;
+
+const float PI = 3.14159265f;
+
+void main () {
+	// Point on the sprite (-1 to 1, y up) - outside the disc is not the sphere
+	vec2 p = vec2(2.0f * gl_PointCoord.x - 1.0f, 1.0f - 2.0f * gl_PointCoord.y);
+	float r2 = dot(p, p);
+	if(r2 > 1.0f) {
+		discard;
+	}
+
+	// Sphere normal facing the viewer (view space)
+	vec4 n = vec4(p, sqrt(1.0f - r2), 0.0f);
+
+	// Texture coordinates from the world space normal (same mapping as the sphere meshes)
+	vec3 world = transpose(mat3(u_View)) * n.xyz;
+	float phi = atan(world.z, world.x);
+	vec2 uv = vec2((phi < 0.0f ? phi + 2.0f * PI : phi) / (2.0f * PI), acos(clamp(world.y, -1.0f, 1.0f)) / PI);
+
+	if(frag_Layer < 0.0f) {
+		Ka = u_Rock_Colour;
+	} else {
+		Ka = texture(u_texture_Map, vec3(uv, frag_Layer));
+	}
+	Kd = Ka;
+	Ks = Ka;
+
+	// The sun is not lit
+	if(frag_Layer == u_Emissive_Layer) {
+		pixel_Colour = Ka;
+		return;
+	}
+
+	// Direction to Light (normalised)
+	vec4 l = normalize(-frag_Light_Direction);
+
+	// Reflected Vector
+	vec4 r = reflect(-l, n);
+
+	// View Vector (sprites face the viewer)
+	vec4 v = vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+	// ---------- Calculate Terms ----------
+	// Ambient Term
+	vec4 Ta = Ka * Ia;
+
+	// Diffuse Term
+	vec4 Td = Kd * max(dot(l, n), 0.0) * Id;
+
+	// Specular Term
+	vec4 Ts = Ks * pow((max(dot(r, v), 0.0)), a) * Is;
+
+
+	//----------------------------------------------
+	// Fragment Colour
+	//----------------------------------------------
+	pixel_Colour = Ta + Td + Ts;
+}
@@ -0,0 +1,38 @@
+// OpenGL 4.0
+#version 400
+
+// Input to Vertex Shader (one point per impostor)
+layout(location = 0) in vec4 vert_Centre;   // World centre (xyz) and radius (w)
+layout(location = 1) in int vert_Layer;     // Texture array layer (-1 for plain rock)
+
+// Per-frame state (shared by every program - see FrameData in main.cpp)
+layout(std140) uniform FrameData {
+	mat4 u_View;
+	mat4 u_Projection;
+	mat4 u_Orientation;
+	vec4 u_Light_Position;
+	float u_Time;
+};
+
+// Pixels per world unit at a distance of 1
+uniform float u_Pixel_Scale;
+
+// Smallest sprite drawn (pixels across)
+uniform float u_Min_Size = 1.5f;
+
+out vec4 frag_Light_Direction;
+out float frag_Layer;
+
+void main() {
+	frag_Layer = float(vert_Layer);
+
+	// View space centre
+	vec4 centre = u_View * vec4(vert_Centre.xyz, 1.0f);
+
+	// Light travels from the light position towards the body
+	frag_Light_Direction = u_View * vec4(vert_Centre.xyz - u_Light_Position.xyz, 0.0f);
+
+	// Sprite covers the projected sphere
+	gl_PointSize = max(2.0f * vert_Centre.w * u_Pixel_Scale / max(-centre.z, 1e-4f), u_Min_Size);
+	gl_Position = u_Projection * centre;
+}
@@ -6,9 +6,10 @@ in vec4 frag_Pos;
 in vec4 frag_UV;
 in vec4 frag_Norm;
 in vec4 frag_Light_Direction;
+in float frag_Layer;
 
-//get texture map
-uniform sampler2D u_texture_Map;
+//get texture map (one layer per body)
+uniform sampler2DArray u_texture_Map;
 
 // Output from Fragment Shader
 out vec4 pixel_Colour;
@@ -25,9 +26,9 @@ uniform float a = 21.264;
 
 void main () {
 
-	Ka = texture(u_texture_Map, frag_UV.xy);
-	Kd = texture(u_texture_Map, frag_UV.xy);
-	Ks = texture(u_texture_Map, frag_UV.xy);
+	Ka = texture(u_texture_Map, vec3(frag_UV.xy, frag_Layer));
+	Kd = Ka;
+	Ks = Ka;
 
 	// Direction to Light (normalised)
 	vec4 l = normalize(-frag_Light_Direction);
@@ -2,32 +2,65 @@
 #version 400
 
 // Input to Vertex Shader
-in vec4 vert_Position;
-in vec4 vert_Norm;
-in vec4 vert_UV;
+layout(location = 0) in vec4 vert_Position;
+layout(location = 1) in vec4 vert_Norm;
+layout(location = 2) in vec4 vert_UV;
 
 // Transform Matrices
-uniform mat4 u_View;
 uniform mat4 u_Model;
-uniform mat4 u_Projection;
 
-//light source
-vec4 u_Light_Direction; //vec4(1.0f, 0.0f, -1.0f, 0.0f);
+// Texture array layer for this body
+uniform float u_Layer;
 
+// Per-frame state (shared by every program - see FrameData in main.cpp)
+layout(std140) uniform FrameData {
+	mat4 u_View;
+	mat4 u_Projection;
+	mat4 u_Orientation;
+	vec4 u_Light_Position;
+	float u_Time;
+};
+
+// Packed vertices (see PackedVertex in geometry.h) - octahedral normal, UV divided by PACKED_UV_RANGE
+uniform bool u_Packed_Vertices = false;
+const float PACKED_UV_RANGE = 2.0f;
+
+out vec4 frag_Pos;
 out vec4 frag_UV;
 out vec4 frag_Norm;
 out vec4 frag_Light_Direction;
+out float frag_Layer;
+
+// Unpack an octahedral normal (packed vertices) or pass it through
+vec4 decodeNormal(vec4 n) {
+	if(!u_Packed_Vertices) {
+		return n;
+	}
+	vec3 d = vec3(n.xy, 1.0f - abs(n.x) - abs(n.y));
+	if(d.z < 0.0f) {
+		d.xy = (1.0f - abs(d.yx)) * vec2(d.x >= 0.0f ? 1.0f : -1.0f, d.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return vec4(normalize(d), 0.0f);
+}
+
+// Rescale packed UVs
+vec4 decodeUV(vec4 uv) {
+	return u_Packed_Vertices ? vec4(uv.xy * PACKED_UV_RANGE, 0.0f, 1.0f) : uv;
+}
 
 void main() {
-	frag_UV = vert_UV;
+	frag_UV = decodeUV(vert_UV);
 
-	frag_Norm = u_View * u_Model * vert_Norm;
+	frag_Layer = u_Layer;
 
-	vec4 direction = -vert_Position;
+	frag_Norm = u_View * u_Model * decodeNormal(vert_Norm);
 
-	u_Light_Direction = normalize(direction);
+	// World and view space position
+	vec4 world_Position = u_Model * vert_Position;
+	frag_Pos = u_View * world_Position;
 
-	frag_Light_Direction = u_View * u_Light_Direction;
+	// Light travels from the light position towards the surface
+	frag_Light_Direction = u_View * vec4(world_Position.xyz - u_Light_Position.xyz, 0.0f);
 
-	gl_Position = u_Projection * u_View * u_Model * vert_Position;
+	gl_Position = u_Projection * frag_Pos;
 }
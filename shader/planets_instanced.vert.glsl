@@ -0,0 +1,65 @@
+// OpenGL 4.0
+#version 400
+
+// Input to Vertex Shader (shared sphere mesh)
+layout(location = 0) in vec4 vert_Position;
+layout(location = 1) in vec4 vert_Norm;
+layout(location = 2) in vec4 vert_UV;
+
+// Input to Vertex Shader (per-instance)
+layout(location = 3) in mat4 inst_Model;
+layout(location = 7) in int inst_Layer;
+
+// Per-frame state (shared by every program - see FrameData in main.cpp)
+layout(std140) uniform FrameData {
+	mat4 u_View;
+	mat4 u_Projection;
+	mat4 u_Orientation;
+	vec4 u_Light_Position;
+	float u_Time;
+};
+
+// Packed vertices (see PackedVertex in geometry.h) - octahedral normal, UV divided by PACKED_UV_RANGE
+uniform bool u_Packed_Vertices = false;
+const float PACKED_UV_RANGE = 2.0f;
+
+out vec4 frag_Pos;
+out vec4 frag_UV;
+out vec4 frag_Norm;
+out vec4 frag_Light_Direction;
+out float frag_Layer;
+
+// Unpack an octahedral normal (packed vertices) or pass it through
+vec4 decodeNormal(vec4 n) {
+	if(!u_Packed_Vertices) {
+		return n;
+	}
+	vec3 d = vec3(n.xy, 1.0f - abs(n.x) - abs(n.y));
+	if(d.z < 0.0f) {
+		d.xy = (1.0f - abs(d.yx)) * vec2(d.x >= 0.0f ? 1.0f : -1.0f, d.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return vec4(normalize(d), 0.0f);
+}
+
+// Rescale packed UVs
+vec4 decodeUV(vec4 uv) {
+	return u_Packed_Vertices ? vec4(uv.xy * PACKED_UV_RANGE, 0.0f, 1.0f) : uv;
+}
+
+void main() {
+	frag_UV = decodeUV(vert_UV);
+
+	// Texture array layer for this body
+	frag_Layer = float(inst_Layer);
+
+	frag_Norm = u_View * inst_Model * decodeNormal(vert_Norm);
+
+	// World and view space position
+	vec4 world_Position = inst_Model * vert_Position;
+	frag_Pos = u_View * world_Position;
+
+	// Light travels from the light position towards the surface
+	frag_Light_Direction = u_View * vec4(world_Position.xyz - u_Light_Position.xyz, 0.0f);
+
+	gl_Position = u_Projection * frag_Pos;
+}
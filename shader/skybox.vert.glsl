@@ -4,9 +4,14 @@
 // Input to Vertex Shader
 in vec4 vert_Position;
 
-// Transform Matrices
-uniform mat4 u_View;
-uniform mat4 u_Projection;
+// Per-frame state (shared by every program - see FrameData in main.cpp)
+layout(std140) uniform FrameData {
+	mat4 u_View;
+	mat4 u_Projection;
+	mat4 u_Orientation;
+	vec4 u_Light_Position;
+	float u_Time;
+};
 
 // Output to Fragment Shader
 out vec3 frag_str;
@@ -23,5 +28,5 @@ void main() {
 	//----------------------------------------------
 	// Vertex Position
 	//----------------------------------------------
-	gl_Position = u_Projection * u_View * vert_Position;
+	gl_Position = u_Projection * u_Orientation * vert_Position;
 }
@@ -4,9 +4,10 @@
 // Input from Vertex Shader
 in vec4 frag_Pos;
 in vec4 frag_UV;
+in float frag_Layer;
 
-//get texture map
-uniform sampler2D u_texture_Map;
+//get texture map (one layer per body)
+uniform sampler2DArray u_texture_Map;
 
 // Output from Fragment Shader
 out vec4 pixel_Colour;
@@ -17,5 +18,5 @@ void main () {
 	//----------------------------------------------
 	// Fragment Colour
 	//----------------------------------------------
-	pixel_Colour = texture(u_texture_Map, frag_UV.xy);
+	pixel_Colour = texture(u_texture_Map, vec3(frag_UV.xy, frag_Layer));
 }
\ No newline at end of file
@@ -2,18 +2,40 @@
 #version 400
 
 // Input to Vertex Shader
-in vec4 vert_Position;
-in vec4 vert_UV;
+layout(location = 0) in vec4 vert_Position;
+layout(location = 2) in vec4 vert_UV;
 
 // Transform Matrices
-uniform mat4 u_View;
 uniform mat4 u_Model;
-uniform mat4 u_Projection;
+
+// Texture array layer for this body
+uniform float u_Layer;
+
+// Per-frame state (shared by every program - see FrameData in main.cpp)
+layout(std140) uniform FrameData {
+	mat4 u_View;
+	mat4 u_Projection;
+	mat4 u_Orientation;
+	vec4 u_Light_Position;
+	float u_Time;
+};
+
+// Packed vertices (see PackedVertex in geometry.h) - octahedral normal, UV divided by PACKED_UV_RANGE
+uniform bool u_Packed_Vertices = false;
+const float PACKED_UV_RANGE = 2.0f;
 
 out vec4 frag_UV;
+out float frag_Layer;
+
+// Rescale packed UVs
+vec4 decodeUV(vec4 uv) {
+	return u_Packed_Vertices ? vec4(uv.xy * PACKED_UV_RANGE, 0.0f, 1.0f) : uv;
+}
 
 void main() {
-	frag_UV = vert_UV;
+	frag_UV = decodeUV(vert_UV);
+
+	frag_Layer = u_Layer;
 
 	gl_Position = u_Projection * u_View * u_Model * vert_Position;
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+// System Headers
+#include <cmath>
+#include <cstring>
+
+// Project Headers
+#include "bodies.h"
+#include "transforms.h"
+
+// --------------------------------------------------------------------------------
+// Body Table
+// --------------------------------------------------------------------------------
+// Reserve space for count bodies
+void BodyTable::reserve(size_t count) {
+	radius.reserve(count);
+	spin_speed.reserve(count);
+	parent.reserve(count);
+	layer.reserve(count);
+	node.reserve(count);
+	eccentricity.reserve(count);
+	epoch_anomaly.reserve(count);
+	mean_motion.reserve(count);
+	px.reserve(count);
+	py.reserve(count);
+	pz.reserve(count);
+	qx.reserve(count);
+	qy.reserve(count);
+	qz.reserve(count);
+	mean_anomaly.reserve(count);
+	x.reserve(count);
+	y.reserve(count);
+	z.reserve(count);
+	spin.reserve(count);
+	model.reserve(count * 16);
+}
+
+// Add a body
+size_t BodyTable::add(const BodyDesc &desc, int texture_layer, SceneGraph &scene) {
+	size_t index = size();
+
+	// Parents must already be in the table
+	if(desc.parent >= (int)index) {
+		std::cerr << "Error: body " << index << " added before its parent " << desc.parent << std::endl;
+	}
+
+	radius.push_back(desc.radius);
+	spin_speed.push_back(desc.spin_speed);
+	parent.push_back(desc.parent < (int)index ? desc.parent : -1);
+	layer.push_back(texture_layer);
+
+	// Orbit centre node under the parent's node
+	node.push_back(scene.addNode(parent[index] >= 0 ? node[parent[index]] : -1));
+
+	// Orbit
+	float P[3], Q[3];
+	orbitBasis(desc.orbit, P, Q);
+	eccentricity.push_back(desc.orbit.eccentricity);
+	epoch_anomaly.push_back(desc.orbit.mean_anomaly);
+	mean_motion.push_back(desc.orbit.mean_motion);
+	px.push_back(P[0]);
+	py.push_back(P[1]);
+	pz.push_back(P[2]);
+	qx.push_back(Q[0]);
+	qy.push_back(Q[1]);
+	qz.push_back(Q[2]);
+
+	// State (filled by evaluateBodies)
+	mean_anomaly.push_back(0.0f);
+	x.push_back(0.0f);
+	y.push_back(0.0f);
+	z.push_back(0.0f);
+	spin.push_back(0.0f);
+
+	// Model matrix (filled by updateBodyTransforms)
+	model.resize(model.size() + 16);
+
+	return index;
+}
+
+// Remove all bodies
+void BodyTable::clear() {
+	radius.clear();
+	spin_speed.clear();
+	parent.clear();
+	layer.clear();
+	node.clear();
+	eccentricity.clear();
+	epoch_anomaly.clear();
+	mean_motion.clear();
+	px.clear();
+	py.clear();
+	pz.clear();
+	qx.clear();
+	qy.clear();
+	qz.clear();
+	mean_anomaly.clear();
+	x.clear();
+	y.clear();
+	z.clear();
+	spin.clear();
+	model.clear();
+}
+
+// Evaluate orbit positions and spin angles at a time
+void evaluateBodies(BodyTable &bodies, double time, JobSystem &jobs) {
+	const double TWO_PI = 2.0 * M_PI;
+
+	const float *epoch = bodies.epoch_anomaly.data();
+	const float *motion = bodies.mean_motion.data();
+	const float *spin_speed = bodies.spin_speed.data();
+
+	jobs.parallelFor(bodies.size(), BODY_GRAIN, [&](size_t begin, size_t end) {
+		// Angles are wrapped in double so long (warped) runs keep float precision -
+		// mean anomalies to [-pi, pi] as the solver expects
+		for(size_t i = begin; i < end; i++) {
+			bodies.mean_anomaly[i] = (float)remainder(epoch[i] + time * motion[i], TWO_PI);
+			bodies.spin[i]         = (float)fmod(time * spin_speed[i], TWO_PI);
+		}
+
+		// Solve Kepler's equation for the whole range in one batch
+		solveOrbits(&bodies.mean_anomaly[begin], &bodies.eccentricity[begin],
+		            &bodies.px[begin], &bodies.py[begin], &bodies.pz[begin],
+		            &bodies.qx[begin], &bodies.qy[begin], &bodies.qz[begin],
+		            &bodies.x[begin], &bodies.y[begin], &bodies.z[begin], end - begin);
+	});
+}
+
+// Compose every model matrix from the evaluated state
+void updateBodyTransforms(BodyTable &bodies, SceneGraph &scene, JobSystem &jobs) {
+	jobs.parallelFor(bodies.size(), BODY_GRAIN, [&](size_t begin, size_t end) {
+		// Compose translate(position) * rotateY(spin) * scale(radius) in one batch -
+		// relative to the parent's centre
+		composeBodyTransforms(&bodies.x[begin], &bodies.y[begin], &bodies.z[begin], &bodies.spin[begin],
+		                      &bodies.radius[begin], &bodies.model[begin * 16], end - begin);
+
+		// Move each body's node to its centre (every body has its own node)
+		for(size_t i = begin; i < end; i++) {
+			scene.setLocalTranslation(bodies.node[i], bodies.x[i], bodies.y[i], bodies.z[i]);
+		}
+	});
+
+	// Propagate through the scene (one ordered pass)
+	scene.update();
+
+	// Place bodies that orbit another body in the parent's frame
+	jobs.parallelFor(bodies.size(), BODY_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			int p = bodies.parent[i];
+			if(p >= 0) {
+				float local[16];
+				float *model = &bodies.model[i * 16];
+				memcpy(local, model, sizeof(local));
+				multiply44(scene.getWorld(bodies.node[p]), local, model);
+			}
+		}
+	});
+}
+
+// Flag the bodies inside the view frustum
+void cullBodies(const float *model, const float *radius, uint8_t *visible, size_t count, const float viewProjection[16], JobSystem &jobs) {
+	// Frustum planes (a,b,c,d) from the rows of the view-projection matrix -
+	// left, right, bottom, top, near, far - normalised so distances are world units
+	const float *M = viewProjection;
+	float planes[6][4];
+	for(int p = 0; p < 6; p++) {
+		int row = p / 2;
+		float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+		for(int c = 0; c < 4; c++) {
+			planes[p][c] = M[c * 4 + 3] + sign * M[c * 4 + row];
+		}
+		float l = length3(planes[p]);
+		multiply4(1.0f / l, planes[p], planes[p]);
+	}
+
+	jobs.parallelFor(count, BODY_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			// Bounding sphere - centre from the model matrix
+			const float *centre = &model[i * 16 + 12];
+
+			// Outside if completely behind any plane
+			uint8_t inside = 1;
+			for(int p = 0; p < 6; p++) {
+				if(dot_product3(planes[p], centre) + planes[p][3] < -radius[i]) {
+					inside = 0;
+					break;
+				}
+			}
+			visible[i] = inside;
+		}
+	});
+}
+
+// Pixels per world unit at a distance of 1
+float getPixelScale(const float projection[16], int viewport_height) {
+	// projection[5] is cot(fovy / 2) - the view height at distance 1 is 2 / projection[5]
+	return 0.5f * projection[5] * viewport_height;
+}
+
+// Choose the mesh level of every visible body
+void selectBodyLevels(const float *model, const float *radius, const uint8_t *visible, int *level, size_t count,
+                      const float eye[3], float pixel_scale, const float *level_error, int num_levels,
+                      const LODSettings &settings, JobSystem &jobs) {
+	// Coarser levels (and skipping) must beat the budget by the hysteresis margin
+	// so bodies near a threshold do not flip between levels every frame
+	const float finer_budget = settings.pixel_error;
+	const float coarser_budget = settings.pixel_error * (1.0f - settings.hysteresis);
+	const float skip_radius = settings.min_radius;
+	const float show_radius = settings.min_radius * (1.0f + settings.hysteresis);
+
+	// No error allowed - every visible body gets the finest mesh (never skipped or an impostor)
+	const bool finest = settings.pixel_error <= 0.0f;
+
+	jobs.parallelFor(count, BODY_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			if(!visible[i]) {
+				continue;
+			}
+			if(finest) {
+				level[i] = 0;
+				continue;
+			}
+
+			// Projected radius in pixels (finest level when the eye is inside the body)
+			const float *centre = &model[i * 16 + 12];
+			float d[3] = {centre[0] - eye[0], centre[1] - eye[1], centre[2] - eye[2]};
+			float distance = length3(d);
+			if(distance <= radius[i]) {
+				level[i] = 0;
+				continue;
+			}
+			float pixels = radius[i] * pixel_scale / distance;
+
+			// Skip bodies too small to see
+			int previous = level[i];
+			if(pixels < (previous < 0 ? show_radius : skip_radius)) {
+				level[i] = -1;
+				continue;
+			}
+
+			// Keep the current level while it is within budget, unless a coarser one is well within it
+			int choice = 0;
+			bool keep = previous >= 0 && previous < num_levels && level_error[previous] * pixels <= finer_budget;
+			for(int l = num_levels - 1; l >= 0; l--) {
+				if(keep && l <= previous) {
+					choice = previous;
+					break;
+				}
+				if(level_error[l] * pixels <= (keep ? coarser_budget : finer_budget)) {
+					choice = l;
+					break;
+				}
+			}
+			level[i] = choice;
+		}
+	});
+}
@@ -81,6 +81,11 @@ void FreeLookCamera::onCursorPosition(GLFWwindow *window, double x, double y) {
 
 // Update Camera
 void FreeLookCamera::update(float dt) {
+	// No keyboard without a window (headless)
+	if(mWindow == NULL) {
+		return;
+	}
+
 	// Get Keyboard input - Q
 	if(glfwGetKey(mWindow, GLFW_KEY_Q) == GLFW_PRESS) {
 		// Roll Right
@@ -0,0 +1,364 @@
+// System Headers
+#include <cstdio>
+#include <cstring>
+
+// Project Headers
+#include "capture.h"
+
+// Maximum frames waiting for the writer before the render thread blocks
+static const size_t MAX_QUEUED_FRAMES = 8;
+
+// --------------------------------------------------------------------------------
+// Image Writers
+// --------------------------------------------------------------------------------
+
+// Parse a format name
+bool parseCaptureFormat(const std::string &name, CaptureFormat &format) {
+	if(name == "png") {
+		format = CAPTURE_PNG;
+	} else if(name == "ppm") {
+		format = CAPTURE_PPM;
+	} else if(name == "raw") {
+		format = CAPTURE_RAW;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// CRC-32 (PNG chunks)
+static unsigned int crc32(unsigned int crc, const unsigned char *data, size_t size) {
+	// Lookup table
+	static unsigned int table[256];
+	static bool table_ready = false;
+	if(!table_ready) {
+		for(unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for(int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		table_ready = true;
+	}
+
+	crc = ~crc;
+	for(size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// Append a big-endian 32-bit value
+static void putBigEndian(std::vector<unsigned char> &out, unsigned int v) {
+	out.push_back((v >> 24) & 0xFF);
+	out.push_back((v >> 16) & 0xFF);
+	out.push_back((v >> 8) & 0xFF);
+	out.push_back(v & 0xFF);
+}
+
+// Write a PNG chunk (length, type, data, CRC)
+static void writeChunk(FILE *file, const char *type, const std::vector<unsigned char> &data) {
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+	fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+// Write a PNG using stored (uncompressed) deflate blocks - fast to encode, the
+// writer thread never becomes the bottleneck
+static bool writePNG(FILE *file, const unsigned char *pixels, int width, int height) {
+	// Signature
+	const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	fwrite(signature, 1, 8, file);
+
+	// Header - 8 bit RGBA
+	std::vector<unsigned char> ihdr;
+	putBigEndian(ihdr, width);
+	putBigEndian(ihdr, height);
+	ihdr.push_back(8);
+	ihdr.push_back(6);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	writeChunk(file, "IHDR", ihdr);
+
+	// Scanlines (filter type 0), top row first
+	size_t row_size = (size_t)width * 4;
+	std::vector<unsigned char> raw((row_size + 1) * height);
+	for(int iy = 0; iy < height; iy++) {
+		unsigned char *row = &raw[iy * (row_size + 1)];
+		row[0] = 0;
+		memcpy(row + 1, &pixels[(size_t)(height - 1 - iy) * row_size], row_size);
+	}
+
+	// zlib stream of stored blocks
+	std::vector<unsigned char> idat;
+	idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+
+	unsigned int a = 1, b = 0;
+	size_t offset = 0;
+	do {
+		size_t block = raw.size() - offset;
+		if(block > 65535) block = 65535;
+
+		// Block header - final flag, length and its complement
+		idat.push_back(offset + block == raw.size() ? 1 : 0);
+		idat.push_back(block & 0xFF);
+		idat.push_back((block >> 8) & 0xFF);
+		idat.push_back(~block & 0xFF);
+		idat.push_back((~block >> 8) & 0xFF);
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + block);
+
+		// Adler-32
+		for(size_t i = offset; i < offset + block; i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+
+		offset += block;
+	} while(offset < raw.size());
+	putBigEndian(idat, (b << 16) | a);
+	writeChunk(file, "IDAT", idat);
+
+	// End
+	writeChunk(file, "IEND", std::vector<unsigned char>());
+
+	return !ferror(file);
+}
+
+// Write a binary PPM (RGB)
+static bool writePPM(FILE *file, const unsigned char *pixels, int width, int height) {
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+	std::vector<unsigned char> row(width * 3);
+	for(int iy = height - 1; iy >= 0; iy--) {
+		const unsigned char *src = &pixels[(size_t)iy * width * 4];
+		for(int ix = 0; ix < width; ix++) {
+			row[ix*3 + 0] = src[ix*4 + 0];
+			row[ix*3 + 1] = src[ix*4 + 1];
+			row[ix*3 + 2] = src[ix*4 + 2];
+		}
+		fwrite(row.data(), 1, row.size(), file);
+	}
+
+	return !ferror(file);
+}
+
+// Write raw RGBA (top row first)
+static bool writeRaw(FILE *file, const unsigned char *pixels, int width, int height) {
+	for(int iy = height - 1; iy >= 0; iy--) {
+		fwrite(&pixels[(size_t)iy * width * 4], 1, (size_t)width * 4, file);
+	}
+
+	return !ferror(file);
+}
+
+// Write RGBA pixels (bottom row first) to file
+bool writeImage(const char *filename, CaptureFormat format, const unsigned char *pixels, int width, int height) {
+	// Open file
+	FILE *file = fopen(filename, "wb");
+
+	// Check file is open
+	if(file == NULL) {
+		// Print Error
+		std::cerr << "Error: Could not open " << filename << std::endl;
+
+		// Return Error
+		return false;
+	}
+
+	bool ok = false;
+	switch(format) {
+		case CAPTURE_PNG: ok = writePNG(file, pixels, width, height); break;
+		case CAPTURE_PPM: ok = writePPM(file, pixels, width, height); break;
+		case CAPTURE_RAW: ok = writeRaw(file, pixels, width, height); break;
+	}
+
+	// Close file
+	fclose(file);
+
+	return ok;
+}
+
+// --------------------------------------------------------------------------------
+// Frame Capture
+// --------------------------------------------------------------------------------
+// Constructor
+FrameCapture::FrameCapture(int width, int height, CaptureFormat format, const std::string &prefix, int ring_size) :
+	mWidth(width), mHeight(height), mFormat(format), mPrefix(prefix),
+	mBuffers(ring_size), mFences(ring_size), mFrameIndex(ring_size), mPending(ring_size, false),
+	mSubmitted(0), mWritten(0), mFailed(0), mStop(false) {
+	// Create PBO ring
+	glGenBuffers(ring_size, mBuffers.data());
+	for(int i = 0; i < ring_size; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+		mFences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Start writer thread
+	mWriter = std::thread(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+	// Flush and stop writer
+	finish();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mQueueChanged.notify_all();
+	mWriter.join();
+
+	// Delete PBO ring
+	glDeleteBuffers(mBuffers.size(), mBuffers.data());
+}
+
+// Start an asynchronous readback of the current read framebuffer
+void FrameCapture::capture(unsigned long frame) {
+	int ring_size = mBuffers.size();
+	int slot = mSubmitted % ring_size;
+
+	// Slot still holds the frame from ring_size frames ago - collect it first
+	if(mPending[slot]) {
+		collect(slot);
+	}
+
+	// Copy into the PBO (returns immediately)
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, mBuffers[slot]);
+	glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Fence so the later map knows the copy has finished
+	mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mFrameIndex[slot] = frame;
+	mPending[slot] = true;
+	mSubmitted++;
+}
+
+// Map the PBO in slot and queue its pixels for writing
+void FrameCapture::collect(int slot) {
+	// Wait for the copy (normally already complete)
+	glClientWaitSync(mFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(mFences[slot]);
+	mFences[slot] = 0;
+	mPending[slot] = false;
+
+	Frame frame;
+	frame.index = mFrameIndex[slot];
+
+	{
+		// Back-pressure - block while the writer is too far behind
+		std::unique_lock<std::mutex> lock(mMutex);
+		mQueueChanged.wait(lock, [this] { return mQueue.size() < MAX_QUEUED_FRAMES; });
+
+		// Reuse a buffer from a written frame
+		if(!mFreeBuffers.empty()) {
+			frame.pixels.swap(mFreeBuffers.back());
+			mFreeBuffers.pop_back();
+		}
+	}
+	frame.pixels.resize((size_t)mWidth * mHeight * 4);
+
+	// Copy pixels out of the PBO
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, mBuffers[slot]);
+	void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.pixels.size(), GL_MAP_READ_BIT);
+	if(data != NULL) {
+		memcpy(frame.pixels.data(), data, frame.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if(data == NULL) {
+		std::cerr << "Error: could not map capture buffer for frame " << frame.index << std::endl;
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFreeBuffers.push_back(std::vector<unsigned char>());
+		mFreeBuffers.back().swap(frame.pixels);
+		mFailed++;
+		return;
+	}
+
+	// Hand to writer
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(Frame());
+		mQueue.back().index = frame.index;
+		mQueue.back().pixels.swap(frame.pixels);
+	}
+	mQueueChanged.notify_all();
+}
+
+// Collect outstanding readbacks and wait for every file to be written
+void FrameCapture::finish() {
+	// Collect in submission order
+	int ring_size = mBuffers.size();
+	for(int i = 0; i < ring_size; i++) {
+		int slot = (mSubmitted + i) % ring_size;
+		if(mPending[slot]) {
+			collect(slot);
+		}
+	}
+
+	// Wait for writer to drain queue
+	std::unique_lock<std::mutex> lock(mMutex);
+	mQueueChanged.wait(lock, [this] { return mQueue.empty(); });
+}
+
+// Frames written so far
+unsigned long FrameCapture::getWritten() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mWritten;
+}
+
+// Frames that could not be read back or written so far
+unsigned long FrameCapture::getFailed() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mFailed;
+}
+
+// Writer thread
+void FrameCapture::writerLoop() {
+	// File extension
+	const char *extension = mFormat == CAPTURE_PNG ? "png" : (mFormat == CAPTURE_PPM ? "ppm" : "raw");
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(true) {
+		// Wait for work
+		mQueueChanged.wait(lock, [this] { return mStop || !mQueue.empty(); });
+		if(mQueue.empty()) {
+			break;
+		}
+
+		// Take frame (stays at the front until written so finish() waits for it)
+		Frame &frame = mQueue.front();
+		lock.unlock();
+
+		// Encode and write
+		char filename[1024];
+		snprintf(filename, sizeof(filename), "%s%06lu.%s", mPrefix.c_str(), frame.index, extension);
+		bool written = writeImage(filename, mFormat, frame.pixels.data(), mWidth, mHeight);
+		if(!written) {
+			std::cerr << "Error: could not write " << filename << std::endl;
+		}
+
+		// Recycle buffer
+		lock.lock();
+		mFreeBuffers.push_back(std::vector<unsigned char>());
+		mFreeBuffers.back().swap(frame.pixels);
+		mQueue.pop_front();
+		if(written) {
+			mWritten++;
+		} else {
+			mFailed++;
+		}
+		mQueueChanged.notify_all();
+	}
+}
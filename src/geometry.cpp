@@ -1,5 +1,11 @@
-// Project Header
+// System Headers
+#include <unordered_map>
+#include <algorithm>
+
+// Project Headers
 #include "geometry.h"
+#include "transforms.h"
+#include "simd.h"
 
 // --------------------------------------------------------------------------------
 // Create Tetrahedron with Positions and Normals
@@ -399,6 +405,15 @@ void createTexturedCube(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3>
 // --------------------------------------------------------------------------------
 // Create Torus with Positions and Normals
 void createTorus(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, float r1, float r2, int sub1, int sub2) {
+	// Grow once to the exact size and fill in place
+	size_t vertex_start = buffer.size(), index_start = indexes.size();
+	buffer.resize(vertex_start + getTorusVertexCount(sub1, sub2) * 2);
+	indexes.resize(index_start + getTorusTriangleCount(sub1, sub2));
+	createTorus(&buffer[vertex_start], &indexes[index_start], r1, r2, sub1, sub2);
+}
+
+// Create Torus into caller storage
+void createTorus(glm::vec4 *buffer, glm::ivec3 *indexes, float r1, float r2, int sub1, int sub2) {
 	// Main Torus Ring
 	for(int i1 = 0; i1 < sub1; i1++) {
 		// Theta [0, 2pi)
@@ -426,15 +441,15 @@ void createTorus(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexe
 			glm::vec4 u2 = glm::normalize(glm::vec4(p2.x, p2.y, p2.z, 0.0f));
 
 			// Add Position and Normal to buffer
-			buffer.push_back(p1 + p2);
-			buffer.push_back(u2);
+			*buffer++ = p1 + p2;
+			*buffer++ = u2;
 
 			// Calculate index
 			int k = i1 * sub2 + i2;
 
 			// Added indexes
-			indexes.push_back(glm::ivec3(k, k + offset2,           k + offset1 + offset2));
-			indexes.push_back(glm::ivec3(k, k + offset1 + offset2, k + offset1));
+			*indexes++ = glm::ivec3(k, k + offset2,           k + offset1 + offset2);
+			*indexes++ = glm::ivec3(k, k + offset1 + offset2, k + offset1);
 		}
 	}
 }
@@ -442,45 +457,866 @@ void createTorus(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexe
 // --------------------------------------------------------------------------------
 // Create Sphere with Positions and Normals
 void createSphereData(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, float r, int sub1, int sub2) {
-	// Longitude
+	// Grow once to the exact size and fill in place
+	size_t vertex_start = buffer.size(), index_start = indexes.size();
+	buffer.resize(vertex_start + getSphereVertexCount(sub1, sub2) * 3);
+	indexes.resize(index_start + getSphereTriangleCount(sub1, sub2));
+	createSphereData(&buffer[vertex_start], &indexes[index_start], r, sub1, sub2);
+}
+
+// Vertices per job when generating spheres in parallel
+const int SPHERE_GRAIN = 16384;
+
+// Sine and cosine of every ring (theta) and column (phi), plus their UVs -
+// computed as the per-vertex loop did (angles rounded to float, float trig)
+struct SphereTables {
+	std::vector<float> sin_theta, cos_theta;
+	std::vector<float> sin_phi, cos_phi;
+	std::vector<float> u, v;
+};
+
+static void createSphereTables(int sub1, int sub2, SphereTables &tables) {
+	tables.sin_theta.resize(sub1);
+	tables.cos_theta.resize(sub1);
+	tables.v.resize(sub1);
 	for(int i1 = 0; i1 < sub1; i1++) {
 		// Theta [0, pi]
 		float theta = i1 * M_PI / (sub1-1);
+		tables.sin_theta[i1] = sinf(theta);
+		tables.cos_theta[i1] = cosf(theta);
+		tables.v[i1] = theta / M_PI;
+	}
 
-		// Longitude offset
-		int offset1 = -sub2;
+	tables.sin_phi.resize(sub2 + 1);
+	tables.cos_phi.resize(sub2 + 1);
+	tables.u.resize(sub2 + 1);
+	for(int i2 = 0; i2 <= sub2; i2++) {
+		// Phi [0, 2pi)
+		float phi = i2 * M_PI * 2.0 / sub2;
+		tables.sin_phi[i2] = sinf(phi);
+		tables.cos_phi[i2] = cosf(phi);
+		tables.u[i2] = phi / (M_PI*2.0f);
+	}
+}
 
-		// Latitude
-		for(int i2 = 0; i2 <= sub2; i2++) {
-			// Phi [0, 2pi)
-			float phi = i2 * M_PI * 2.0 / sub2;
+// One row of sphere vertices - position (r_sin_theta * cos phi, y, r_sin_theta * sin phi),
+// normal (position * 1 / sqrt((x*x + y*y) + z*z)) and UV, all in float like the
+// per-vertex loop. Every kernel performs the same IEEE operations in the same
+// order so they give identical bits.
+static void createSphereRowScalar(const float *cos_phi, const float *sin_phi, const float *u,
+                                  float r_sin_theta, float y, float v, int count, glm::vec4 *buffer) {
+	for(int i = 0; i < count; i++) {
+		float x = r_sin_theta * cos_phi[i];
+		float z = r_sin_theta * sin_phi[i];
+		float inv = 1.0f / sqrtf((x*x + y*y) + z*z);
+
+		buffer[i * 3 + 0] = glm::vec4(x, y, z, 1.0f);
+		buffer[i * 3 + 1] = glm::vec4(x * inv, y * inv, z * inv, 0.0f);
+		buffer[i * 3 + 2] = glm::vec4(u[i], v, 0.0f, 1.0f);
+	}
+}
 
-			// Calculate point
-			glm::vec4 p = glm::vec4(r*sin(theta)*cos(phi), r*cos(theta), r*sin(theta)*sin(phi), 1.0f);
+#if defined(SIMD_X86)
+// Store 4 vertices held as component columns (x, y, z, w)
+static inline void storeSphereVertices(__m128 x, __m128 y, __m128 z, __m128 inv, __m128 u, __m128 v, glm::vec4 *buffer) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 p0 = x, p1 = y, p2 = z, p3 = one;
+	__m128 n0 = _mm_mul_ps(x, inv), n1 = _mm_mul_ps(y, inv), n2 = _mm_mul_ps(z, inv), n3 = zero;
+	__m128 t0 = u, t1 = v, t2 = zero, t3 = one;
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+	_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+	float *out = (float*)buffer;
+	_mm_storeu_ps(out +  0, p0); _mm_storeu_ps(out +  4, n0); _mm_storeu_ps(out +  8, t0);
+	_mm_storeu_ps(out + 12, p1); _mm_storeu_ps(out + 16, n1); _mm_storeu_ps(out + 20, t1);
+	_mm_storeu_ps(out + 24, p2); _mm_storeu_ps(out + 28, n2); _mm_storeu_ps(out + 32, t2);
+	_mm_storeu_ps(out + 36, p3); _mm_storeu_ps(out + 40, n3); _mm_storeu_ps(out + 44, t3);
+}
 
-			// Calculate normal
-			glm::vec4 u = glm::normalize(glm::vec4(p.x, p.y, p.z, 0.0f));
+// 4 vertices per iteration
+static void createSphereRowSSE2(const float *cos_phi, const float *sin_phi, const float *u,
+                                float r_sin_theta, float y, float v, int count, glm::vec4 *buffer) {
+	const __m128 rs = _mm_set1_ps(r_sin_theta);
+	const __m128 yy = _mm_set1_ps(y);
+	const __m128 vv = _mm_set1_ps(v);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 x = _mm_mul_ps(rs, _mm_loadu_ps(cos_phi + i));
+		__m128 z = _mm_mul_ps(rs, _mm_loadu_ps(sin_phi + i));
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(yy, yy)), _mm_mul_ps(z, z));
+		__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(dot));
+		storeSphereVertices(x, yy, z, inv, _mm_loadu_ps(u + i), vv, buffer + i * 3);
+	}
 
-			// Add position, normal and UV to buffer
-			buffer.push_back(p);
-			buffer.push_back(u);
-			buffer.push_back(glm::vec4(phi / (M_PI*2.0f), theta / M_PI, 0.0f, 1.0f));
+	// Remainder
+	createSphereRowScalar(cos_phi + i, sin_phi + i, u + i, r_sin_theta, y, v, count - i, buffer + i * 3);
+}
 
+// 8 vertices per iteration
+__attribute__((target("avx2")))
+static void createSphereRowAVX2(const float *cos_phi, const float *sin_phi, const float *u,
+                                float r_sin_theta, float y, float v, int count, glm::vec4 *buffer) {
+	const __m256 rs = _mm256_set1_ps(r_sin_theta);
+	const __m256 yy = _mm256_set1_ps(y);
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_mul_ps(rs, _mm256_loadu_ps(cos_phi + i));
+		__m256 z = _mm256_mul_ps(rs, _mm256_loadu_ps(sin_phi + i));
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(yy, yy)), _mm256_mul_ps(z, z));
+		__m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(dot));
+
+		// Interleave each half as 4 vertices
+		storeSphereVertices(_mm256_castps256_ps128(x), _mm256_castps256_ps128(yy), _mm256_castps256_ps128(z),
+		                    _mm256_castps256_ps128(inv), _mm_loadu_ps(u + i), _mm_set1_ps(v), buffer + i * 3);
+		storeSphereVertices(_mm256_extractf128_ps(x, 1), _mm256_castps256_ps128(yy), _mm256_extractf128_ps(z, 1),
+		                    _mm256_extractf128_ps(inv, 1), _mm_loadu_ps(u + i + 4), _mm_set1_ps(v), buffer + (i + 4) * 3);
+	}
 
-			// Latitude offset
-			int offset2 = (i2 < (sub2 - 1)) ? 1 : -(sub2 - 1);
+	// Remainder
+	createSphereRowScalar(cos_phi + i, sin_phi + i, u + i, r_sin_theta, y, v, count - i, buffer + i * 3);
+}
+#endif // SIMD_X86
+
+// Rows [begin, end) of a sphere - vertices with the current transform kernel, then indexes
+static void createSphereRows(const SphereTables &tables, float r, int sub1, int sub2, int begin, int end,
+                             glm::vec4 *buffer, glm::ivec3 *indexes) {
+	for(int i1 = begin; i1 < end; i1++) {
+		float r_sin_theta = r*tables.sin_theta[i1];
+		float y = r*tables.cos_theta[i1];
+		glm::vec4 *row = buffer + (size_t)i1 * (sub2 + 1) * 3;
+
+		switch(getTransformKernel()) {
+#if defined(SIMD_X86)
+			case TRANSFORM_AVX2:
+				createSphereRowAVX2(tables.cos_phi.data(), tables.sin_phi.data(), tables.u.data(), r_sin_theta, y, tables.v[i1], sub2 + 1, row);
+				break;
+			case TRANSFORM_SSE2:
+				createSphereRowSSE2(tables.cos_phi.data(), tables.sin_phi.data(), tables.u.data(), r_sin_theta, y, tables.v[i1], sub2 + 1, row);
+				break;
+#endif
+			default:
+				createSphereRowScalar(tables.cos_phi.data(), tables.sin_phi.data(), tables.u.data(), r_sin_theta, y, tables.v[i1], sub2 + 1, row);
+				break;
+		}
+
+		// Add triangles between layers
+		if(i1 > 0) {
+			// Longitude offset
+			int offset1 = -sub2;
+			glm::ivec3 *triangle = indexes + (size_t)(i1 - 1) * (sub2 + 1) * 2;
+			for(int i2 = 0; i2 <= sub2; i2++) {
+				// Latitude offset
+				int offset2 = (i2 < (sub2 - 1)) ? 1 : -(sub2 - 1);
 
-			// Add triangles between layers
-			if(i1 > 0) {
 				// Index of current vertex
 				int k = i1*sub2 + i2;
 
 				// Add Indexes
-				indexes.push_back(glm::ivec3(k + offset1, k,           k + offset2));
-				indexes.push_back(glm::ivec3(k + offset1, k + offset2, k + offset1 + offset2));
+				*triangle++ = glm::ivec3(k + offset1, k,           k + offset2);
+				*triangle++ = glm::ivec3(k + offset1, k + offset2, k + offset1 + offset2);
+			}
+		}
+	}
+}
+
+// Create Sphere into caller storage
+void createSphereData(glm::vec4 *buffer, glm::ivec3 *indexes, float r, int sub1, int sub2) {
+	SphereTables tables;
+	createSphereTables(sub1, sub2, tables);
+	createSphereRows(tables, r, sub1, sub2, 0, sub1, buffer, indexes);
+}
+
+// Create Sphere with rows split across the job system
+void createSphereData(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, float r, int sub1, int sub2, JobSystem &jobs) {
+	size_t vertex_start = buffer.size(), index_start = indexes.size();
+	buffer.resize(vertex_start + getSphereVertexCount(sub1, sub2) * 3);
+	indexes.resize(index_start + getSphereTriangleCount(sub1, sub2));
+	createSphereData(&buffer[vertex_start], &indexes[index_start], r, sub1, sub2, jobs);
+}
+
+// Create Sphere into caller storage with rows split across the job system
+void createSphereData(glm::vec4 *buffer, glm::ivec3 *indexes, float r, int sub1, int sub2, JobSystem &jobs) {
+	SphereTables tables;
+	createSphereTables(sub1, sub2, tables);
+	size_t grain = std::max(1, SPHERE_GRAIN / (sub2 + 1));
+	jobs.parallelFor(sub1, grain, [&](size_t begin, size_t end) {
+		createSphereRows(tables, r, sub1, sub2, begin, end, buffer, indexes);
+	});
+}
+
+// --------------------------------------------------------------------------------
+// Sphere Levels of Detail
+// --------------------------------------------------------------------------------
+// Append one level made of unit directions and triangles - adds UVs that match
+// createSphereData (u = phi / 2pi, v = theta / pi) and duplicates the vertices
+// that need a second UV: along the u = 0/1 seam and at the poles
+static void addSphereLevel(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels,
+                           const std::vector<glm::vec3> &directions, const std::vector<glm::ivec3> &triangles, float r) {
+	MeshLevel level;
+	level.first_vertex = buffer.size() / 3;
+	level.first_triangle = indexes.size();
+	level.triangles = triangles.size();
+	level.first_index = level.first_triangle * 3;
+	level.indices = level.triangles * 3;
+
+	// Vertex UVs (u is meaningless at the poles - fixed per triangle below)
+	std::vector<glm::vec2> uvs(directions.size());
+	std::vector<bool> pole(directions.size());
+	for(size_t i = 0; i < directions.size(); i++) {
+		const glm::vec3 &d = directions[i];
+		float phi = atan2(d.z, d.x);
+		if(phi < 0.0f) {
+			phi += M_PI * 2.0;
+		}
+		uvs[i] = glm::vec2(phi / (M_PI * 2.0), acos(glm::clamp(d.y, -1.0f, 1.0f)) / M_PI);
+		pole[i] = d.x * d.x + d.z * d.z < 1e-10f;
+	}
+
+	// Add a vertex and return its absolute index
+	std::vector<glm::vec3> extra_directions;
+	std::vector<glm::vec2> extra_uvs;
+	int next = level.first_vertex + directions.size();
+	auto addVertex = [&](int i, const glm::vec2 &uv) {
+		extra_directions.push_back(directions[i]);
+		extra_uvs.push_back(uv);
+		return next++;
+	};
+
+	for(size_t t = 0; t < triangles.size(); t++) {
+		int v[3] = {triangles[t].x, triangles[t].y, triangles[t].z};
+		glm::vec2 uv[3] = {uvs[v[0]], uvs[v[1]], uvs[v[2]]};
+		int index[3] = {level.first_vertex + v[0], level.first_vertex + v[1], level.first_vertex + v[2]};
+
+		// Triangles spanning the seam use u + 1 on the side near u = 0
+		float u_min = 1.0f, u_max = 0.0f;
+		for(int k = 0; k < 3; k++) {
+			if(!pole[v[k]]) {
+				u_min = std::min(u_min, uv[k].x);
+				u_max = std::max(u_max, uv[k].x);
+			}
+		}
+		bool seam = u_max - u_min > 0.5f;
+		for(int k = 0; k < 3; k++) {
+			if(seam && !pole[v[k]] && uv[k].x < 0.5f) {
+				uv[k].x += 1.0f;
+				index[k] = addVertex(v[k], uv[k]);
+			}
+		}
+
+		// Pole vertices take the mean u of the other two corners
+		for(int k = 0; k < 3; k++) {
+			if(pole[v[k]]) {
+				uv[k].x = 0.5f * (uv[(k + 1) % 3].x + uv[(k + 2) % 3].x);
+				index[k] = addVertex(v[k], uv[k]);
+			}
+		}
+
+		indexes.push_back(glm::ivec3(index[0], index[1], index[2]));
+	}
+
+	// Vertices - shared ones first, then the duplicates (count now known, so grow once)
+	size_t count = directions.size() + extra_directions.size();
+	size_t start = buffer.size();
+	buffer.resize(start + count * 3);
+	glm::vec4 *vertex = &buffer[start];
+	for(size_t i = 0; i < count; i++) {
+		bool shared = i < directions.size();
+		const glm::vec3 &d = shared ? directions[i] : extra_directions[i - directions.size()];
+		const glm::vec2 &uv = shared ? uvs[i] : extra_uvs[i - directions.size()];
+		*vertex++ = glm::vec4(d * r, 1.0f);
+		*vertex++ = glm::vec4(d, 0.0f);
+		*vertex++ = glm::vec4(uv.x, uv.y, 0.0f, 1.0f);
+	}
+
+	// Geometric error - the sphere bulges furthest above a triangle's plane
+	level.error = 0.0f;
+	for(size_t t = 0; t < triangles.size(); t++) {
+		const glm::vec3 &a = directions[triangles[t].x];
+		glm::vec3 n = glm::normalize(glm::cross(directions[triangles[t].y] - a, directions[triangles[t].z] - a));
+		level.error = std::max(level.error, 1.0f - glm::dot(n, a));
+	}
+
+	level.vertices = count;
+	levels.push_back(level);
+}
+
+// --------------------------------------------------------------------------------
+// Create Icosphere LOD chain with Positions, Normals and UVs
+void createIcosphereLODs(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, float r, int num_levels) {
+	// Exact sizes - subdividing n times gives 20 * 4^n triangles and 10 * 4^n + 2 directions
+	size_t total_triangles = 0;
+	for(int n = 0; n < num_levels; n++) {
+		total_triangles += (size_t)20 << (2 * n);
+	}
+	indexes.reserve(indexes.size() + total_triangles);
+	levels.reserve(levels.size() + num_levels);
+
+	// Icosahedron with a vertex on each pole and two rings of five at +-atan(1/2)
+	std::vector<glm::vec3> directions;
+	std::vector<glm::ivec3> triangles;
+	directions.reserve(((size_t)10 << (2 * (num_levels - 1))) + 2);
+
+	float ring_y = 1.0f / sqrt(5.0f);
+	float ring_r = 2.0f / sqrt(5.0f);
+	directions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+	for(int i = 0; i < 10; i++) {
+		// Upper ring (1-5) then lower ring (6-10) offset by half a step
+		float phi = (i % 5 + (i < 5 ? 0.0f : 0.5f)) * M_PI * 2.0 / 5.0;
+		directions.push_back(glm::vec3(ring_r * cos(phi), i < 5 ? ring_y : -ring_y, ring_r * sin(phi)));
+	}
+	directions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+
+	// Counter-clockwise seen from outside
+	for(int i = 0; i < 5; i++) {
+		int u0 = 1 + i, u1 = 1 + (i + 1) % 5;
+		int l0 = 6 + i, l1 = 6 + (i + 1) % 5;
+		triangles.push_back(glm::ivec3(0, u1, u0));
+		triangles.push_back(glm::ivec3(u0, u1, l0));
+		triangles.push_back(glm::ivec3(l0, u1, l1));
+		triangles.push_back(glm::ivec3(l0, l1, 11));
+	}
+
+	// Subdivide up to the finest level - every edge split at its (normalised) midpoint
+	std::vector< std::vector<glm::ivec3> > chain;
+	chain.reserve(num_levels);
+	chain.push_back(triangles);
+	for(int n = 1; n < num_levels; n++) {
+		// One midpoint per edge (3 edges per triangle, each shared by two)
+		const std::vector<glm::ivec3> &coarse = chain.back();
+		std::unordered_map<unsigned long long, int> midpoints;
+		midpoints.reserve(coarse.size() * 3 / 2);
+		auto midpoint = [&](int a, int b) {
+			unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | (unsigned int)std::max(a, b);
+			std::unordered_map<unsigned long long, int>::iterator it = midpoints.find(key);
+			if(it != midpoints.end()) {
+				return it->second;
+			}
+			directions.push_back(glm::normalize(directions[a] + directions[b]));
+			midpoints[key] = directions.size() - 1;
+			return (int)directions.size() - 1;
+		};
+
+		std::vector<glm::ivec3> fine;
+		fine.reserve(coarse.size() * 4);
+		for(size_t t = 0; t < coarse.size(); t++) {
+			int a = coarse[t].x, b = coarse[t].y, c = coarse[t].z;
+			int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+			fine.push_back(glm::ivec3(a, ab, ca));
+			fine.push_back(glm::ivec3(ab, b, bc));
+			fine.push_back(glm::ivec3(ca, bc, c));
+			fine.push_back(glm::ivec3(ab, bc, ca));
+		}
+		chain.push_back(fine);
+	}
 
+	// Each level's vertices are a prefix of the finest level's (midpoints are
+	// appended), so a level only needs the directions its triangles use
+	for(int n = num_levels - 1; n >= 0; n--) {
+		int used = 0;
+		for(size_t t = 0; t < chain[n].size(); t++) {
+			used = std::max(used, std::max(chain[n][t].x, std::max(chain[n][t].y, chain[n][t].z)) + 1);
+		}
+		std::vector<glm::vec3> level_directions(directions.begin(), directions.begin() + used);
+		addSphereLevel(buffer, indexes, levels, level_directions, chain[n], r);
+	}
+}
+
+// --------------------------------------------------------------------------------
+// Create Cube Sphere LOD chain with Positions, Normals and UVs
+void createCubeSphereLODs(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, float r, const int *subdivisions, int num_levels) {
+	// Faces as (normal, right, up) - right x up = normal so triangles wind counter-clockwise
+	const glm::vec3 faces[6][3] = {
+		{glm::vec3( 1, 0, 0), glm::vec3(0, 0,-1), glm::vec3(0, 1, 0)},
+		{glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)},
+		{glm::vec3( 0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0,-1)},
+		{glm::vec3( 0,-1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)},
+		{glm::vec3( 0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)},
+		{glm::vec3( 0, 0,-1), glm::vec3(-1,0, 0), glm::vec3(0, 1, 0)}
+	};
+
+	// Exact triangle count - two per cell, sub^2 cells on each of six faces
+	size_t total_triangles = 0;
+	for(int n = 0; n < num_levels; n++) {
+		total_triangles += 12 * subdivisions[n] * subdivisions[n];
+	}
+	indexes.reserve(indexes.size() + total_triangles);
+	levels.reserve(levels.size() + num_levels);
+
+	for(int n = 0; n < num_levels; n++) {
+		int sub = subdivisions[n];
+		std::vector<glm::vec3> directions;
+		std::vector<glm::ivec3> triangles;
+		directions.reserve(6 * (sub + 1) * (sub + 1));
+		triangles.reserve(12 * sub * sub);
+
+		for(int f = 0; f < 6; f++) {
+			int base = directions.size();
+
+			// Grid of (sub + 1)^2 points on the face
+			for(int j = 0; j <= sub; j++) {
+				for(int i = 0; i <= sub; i++) {
+					glm::vec3 p = faces[f][0] + faces[f][1] * (2.0f * i / sub - 1.0f) + faces[f][2] * (2.0f * j / sub - 1.0f);
+
+					// Cube to sphere with evenly sized cells (better than normalize(p))
+					glm::vec3 p2 = p * p;
+					directions.push_back(glm::normalize(glm::vec3(
+						p.x * sqrt(1.0f - p2.y / 2.0f - p2.z / 2.0f + p2.y * p2.z / 3.0f),
+						p.y * sqrt(1.0f - p2.z / 2.0f - p2.x / 2.0f + p2.z * p2.x / 3.0f),
+						p.z * sqrt(1.0f - p2.x / 2.0f - p2.y / 2.0f + p2.x * p2.y / 3.0f))));
+				}
+			}
 
+			// Two triangles per cell
+			for(int j = 0; j < sub; j++) {
+				for(int i = 0; i < sub; i++) {
+					int k = base + j * (sub + 1) + i;
+					triangles.push_back(glm::ivec3(k, k + 1, k + sub + 2));
+					triangles.push_back(glm::ivec3(k, k + sub + 2, k + sub + 1));
+				}
 			}
 		}
+
+		addSphereLevel(buffer, indexes, levels, directions, triangles, r);
+	}
+}
+
+// --------------------------------------------------------------------------------
+// Round [-1, 1] to a signed normalised short
+static GLshort packSnorm(float v) {
+	return (GLshort)round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Round [0, 1] to an unsigned normalised short
+static GLushort packUnorm(float v) {
+	return (GLushort)round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
+
+// Pack a buffer of (position, normal, UV) vec4 triples - one PackedVertex each
+void packVertices(const std::vector<glm::vec4> &buffer, std::vector<PackedVertex> &packed) {
+	packed.resize(buffer.size() / 3);
+	packVertices(buffer.data(), packed.size(), packed.data());
+}
+
+// Pack vertices into caller storage (e.g. a mapped vertex buffer)
+void packVertices(const glm::vec4 *buffer, size_t vertices, PackedVertex *packed) {
+	for(size_t i = 0; i < vertices; i++) {
+		const glm::vec4 &position = buffer[i * 3 + 0];
+		const glm::vec4 &normal   = buffer[i * 3 + 1];
+		const glm::vec4 &uv       = buffer[i * 3 + 2];
+		PackedVertex &vertex = packed[i];
+
+		vertex.position[0] = packSnorm(position.x);
+		vertex.position[1] = packSnorm(position.y);
+		vertex.position[2] = packSnorm(position.z);
+		vertex.position[3] = 32767;
+
+		// Octahedral normal - project onto |x| + |y| + |z| = 1 and fold the lower half over
+		glm::vec3 n = glm::vec3(normal) / (fabs(normal.x) + fabs(normal.y) + fabs(normal.z));
+		glm::vec2 e = glm::vec2(n.x, n.y);
+		if(n.z < 0.0f) {
+			e = glm::vec2((1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+			              (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		vertex.normal[0] = packSnorm(e.x);
+		vertex.normal[1] = packSnorm(e.y);
+
+		vertex.uv[0] = packUnorm(uv.x / PACKED_UV_RANGE);
+		vertex.uv[1] = packUnorm(uv.y / PACKED_UV_RANGE);
 	}
 }
+
+// --------------------------------------------------------------------------------
+// Append strips covering triangles [first, first + count) - greedy: each strip
+// starts at the free triangle with the fewest free neighbours and follows the
+// neighbour across its last edge for as long as the winding allows
+static void buildStrips(const std::vector<glm::ivec3> &indexes, int first, int count, std::vector<GLuint> &strips) {
+	// Triangles on the far side of each directed edge (b, a) of triangle (a, b, c)
+	std::unordered_map<unsigned long long, int> edges;
+	auto key = [](GLuint a, GLuint b) { return ((unsigned long long)a << 32) | b; };
+	for(int t = 0; t < count; t++) {
+		const glm::ivec3 &tri = indexes[first + t];
+		for(int k = 0; k < 3; k++) {
+			edges[key(tri[k], tri[(k + 1) % 3])] = t;
+		}
+	}
+
+	// Neighbour across edge (a, b) of a triangle - the one holding (b, a)
+	std::vector<bool> used(count, false);
+	auto neighbour = [&](GLuint a, GLuint b) {
+		std::unordered_map<unsigned long long, int>::const_iterator it = edges.find(key(b, a));
+		return (it == edges.end() || used[it->second]) ? -1 : it->second;
+	};
+	auto freeNeighbours = [&](int t) {
+		const glm::ivec3 &tri = indexes[first + t];
+		int n = 0;
+		for(int k = 0; k < 3; k++) {
+			n += neighbour(tri[k], tri[(k + 1) % 3]) >= 0;
+		}
+		return n;
+	};
+
+	int remaining = count;
+	while(remaining > 0) {
+		// Start at the most isolated free triangle so corners are not stranded
+		int start = -1, fewest = 4;
+		for(int t = 0; t < count && fewest > 0; t++) {
+			if(!used[t]) {
+				int n = freeNeighbours(t);
+				if(n < fewest) {
+					start = t;
+					fewest = n;
+				}
+			}
+		}
+
+		// Rotate so the strip leaves across an edge with a free neighbour
+		glm::ivec3 tri = indexes[first + start];
+		used[start] = true;
+		remaining--;
+		for(int k = 0; k < 3 && neighbour(tri.y, tri.z) < 0; k++) {
+			tri = glm::ivec3(tri.y, tri.z, tri.x);
+		}
+
+		if(!strips.empty()) {
+			strips.push_back(primitiveRestartIndex(GL_UNSIGNED_INT));
+		}
+		strips.push_back(tri.x);
+		strips.push_back(tri.y);
+		strips.push_back(tri.z);
+
+		// Strip triangles after the last two indexes (a, b) are drawn (a, b, c) when
+		// even and (b, a, c) when odd, so the next one is across (a, b) or (b, a)
+		GLuint a = tri.y, b = tri.z;
+		for(bool odd = true; ; odd = !odd) {
+			int next = odd ? neighbour(a, b) : neighbour(b, a);
+			if(next < 0) {
+				break;
+			}
+			const glm::ivec3 &n = indexes[first + next];
+			GLuint c = n.x + n.y + n.z - a - b;
+			used[next] = true;
+			remaining--;
+			strips.push_back(c);
+			a = b;
+			b = c;
+		}
+	}
+}
+
+// Build an index buffer from triangles - every level's range is converted (and
+// first_index/indices updated) and strips are built when requested
+void buildIndexBuffer(const std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, bool strips, IndexBuffer &buffer) {
+	// Largest index decides the type
+	GLuint largest = 0;
+	for(size_t t = 0; t < indexes.size(); t++) {
+		largest = std::max(largest, (GLuint)std::max(indexes[t].x, std::max(indexes[t].y, indexes[t].z)));
+	}
+	buffer.type = largest < primitiveRestartIndex(GL_UNSIGNED_SHORT) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	buffer.mode = strips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+
+	// Indexes per level
+	std::vector<GLuint> all;
+	all.reserve(indexes.size() * 3);
+	for(size_t l = 0; l < levels.size(); l++) {
+		MeshLevel &level = levels[l];
+		level.first_index = all.size();
+		if(buffer.mode == GL_TRIANGLE_STRIP) {
+			std::vector<GLuint> level_strips;
+			buildStrips(indexes, level.first_triangle, level.triangles, level_strips);
+			all.insert(all.end(), level_strips.begin(), level_strips.end());
+		} else {
+			for(int t = level.first_triangle; t < level.first_triangle + level.triangles; t++) {
+				all.push_back(indexes[t].x);
+				all.push_back(indexes[t].y);
+				all.push_back(indexes[t].z);
+			}
+		}
+		level.indices = all.size() - level.first_index;
+	}
+
+	// Narrow (the 32-bit restart index becomes the 16-bit one)
+	buffer.shorts.clear();
+	buffer.ints.clear();
+	if(buffer.type == GL_UNSIGNED_SHORT) {
+		buffer.shorts.assign(all.begin(), all.end());
+	} else {
+		buffer.ints.swap(all);
+	}
+}
+
+// A whole mesh as one level
+static MeshLevel wholeMesh(int vertices, int triangles) {
+	MeshLevel level;
+	level.first_vertex = 0;
+	level.vertices = vertices;
+	level.first_triangle = 0;
+	level.triangles = triangles;
+	level.first_index = 0;
+	level.indices = triangles * 3;
+	level.error = 0.0f;
+	return level;
+}
+
+// Build a triangle list index buffer in the narrowest type
+void buildIndexBuffer(const std::vector<glm::ivec3> &indexes, IndexBuffer &buffer) {
+	// The whole buffer as one level (vertex range unused)
+	std::vector<MeshLevel> levels(1, wholeMesh(0, indexes.size()));
+	buildIndexBuffer(indexes, levels, false, buffer);
+}
+
+// --------------------------------------------------------------------------------
+// Cache statistics of one level's range of an index buffer (lists or strips)
+VertexCacheStats analyzeVertexCache(const IndexBuffer &buffer, const MeshLevel &level, int cache_size) {
+	// FIFO of vertex indexes - every index (strip or list) is one lookup
+	const GLuint restart = primitiveRestartIndex(buffer.type);
+	std::vector<GLuint> cache(cache_size, restart);
+	int head = 0, misses = 0;
+	for(int i = level.first_index; i < level.first_index + level.indices; i++) {
+		GLuint v = buffer.type == GL_UNSIGNED_SHORT ? buffer.shorts[i] : buffer.ints[i];
+		if(buffer.mode == GL_TRIANGLE_STRIP && v == restart) {
+			continue;
+		}
+		if(std::find(cache.begin(), cache.end(), v) == cache.end()) {
+			cache[head] = v;
+			head = (head + 1) % cache_size;
+			misses++;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = level.triangles > 0 ? (float)misses / level.triangles : 0.0f;
+	stats.atvr = level.vertices > 0 ? (float)misses / level.vertices : 0.0f;
+	return stats;
+}
+
+// Forsyth vertex score constants ("Linear-Speed Vertex Cache Optimisation")
+const int   FORSYTH_CACHE_SIZE     = 32;
+const float FORSYTH_DECAY_POWER    = 1.5f;
+const float FORSYTH_LAST_TRIANGLE  = 0.75f;
+const float FORSYTH_VALENCE_SCALE  = 2.0f;
+const float FORSYTH_VALENCE_POWER  = 0.5f;
+
+// Triangles per cluster for the overdraw sort
+const int OVERDRAW_CLUSTER = 64;
+
+// Score of a vertex from its cache position (-1 when not cached) and unadded triangles
+static float forsythScore(int position, int remaining) {
+	if(remaining == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if(position >= 0) {
+		if(position < 3) {
+			// In the triangle just added - same score whichever way it is used
+			score = FORSYTH_LAST_TRIANGLE;
+		} else {
+			score = pow(1.0f - (float)(position - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_DECAY_POWER);
+		}
+	}
+
+	// Favour vertices with few triangles left so they are finished off
+	return score + FORSYTH_VALENCE_SCALE * pow((float)remaining, -FORSYTH_VALENCE_POWER);
+}
+
+// Reorder triangles (local vertex numbers 0 to vertices - 1) for the post-transform cache
+static void optimizeVertexCache(std::vector<glm::ivec3> &triangles, int vertices) {
+	// Triangles using each vertex
+	std::vector<int> offsets(vertices + 1, 0);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		for(int k = 0; k < 3; k++) {
+			offsets[triangles[t][k] + 1]++;
+		}
+	}
+	for(int v = 0; v < vertices; v++) {
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<int> adjacency(offsets[vertices]);
+	std::vector<int> remaining(vertices, 0);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		for(int k = 0; k < 3; k++) {
+			int v = triangles[t][k];
+			adjacency[offsets[v] + remaining[v]++] = t;
+		}
+	}
+
+	// Vertex and triangle scores
+	std::vector<int> position(vertices, -1);
+	std::vector<float> vertex_score(vertices);
+	for(int v = 0; v < vertices; v++) {
+		vertex_score[v] = forsythScore(-1, remaining[v]);
+	}
+	std::vector<float> triangle_score(triangles.size());
+	std::vector<bool> added(triangles.size(), false);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		triangle_score[t] = vertex_score[triangles[t].x] + vertex_score[triangles[t].y] + vertex_score[triangles[t].z];
+	}
+
+	// Cache holds FORSYTH_CACHE_SIZE vertices plus up to 3 pushed out by the newest triangle
+	std::vector<int> cache, next_cache;
+	std::vector<glm::ivec3> order;
+	order.reserve(triangles.size());
+	size_t scan = 0;
+	int best = -1;
+	while(order.size() < triangles.size()) {
+		// Nothing cached is usable - best of the remaining triangles (in order)
+		if(best < 0) {
+			float best_score = -1.0f;
+			for(size_t t = scan; t < triangles.size(); t++) {
+				if(!added[t] && triangle_score[t] > best_score) {
+					best = t;
+					best_score = triangle_score[t];
+				}
+			}
+			while(added[scan]) {
+				scan++;
+			}
+		}
+
+		// Add the triangle - its vertices go to the front of the cache
+		const glm::ivec3 tri = triangles[best];
+		order.push_back(tri);
+		added[best] = true;
+		next_cache.assign(&tri[0], &tri[0] + 3);
+		for(size_t c = 0; c < cache.size(); c++) {
+			if(cache[c] != tri.x && cache[c] != tri.y && cache[c] != tri.z) {
+				next_cache.push_back(cache[c]);
+			}
+		}
+		for(int k = 0; k < 3; k++) {
+			int v = tri[k];
+			int *list = &adjacency[offsets[v]];
+			for(int i = 0; i < remaining[v]; i++) {
+				if(list[i] == best) {
+					list[i] = list[--remaining[v]];
+					break;
+				}
+			}
+		}
+		cache.swap(next_cache);
+
+		// Rescore cached vertices (and the ones just pushed out) and their triangles
+		for(size_t c = 0; c < cache.size(); c++) {
+			position[cache[c]] = c < (size_t)FORSYTH_CACHE_SIZE ? c : -1;
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for(size_t c = 0; c < cache.size(); c++) {
+			int v = cache[c];
+			float delta = forsythScore(position[v], remaining[v]) - vertex_score[v];
+			vertex_score[v] += delta;
+			for(int i = 0; i < remaining[v]; i++) {
+				triangle_score[adjacency[offsets[v] + i]] += delta;
+			}
+		}
+		for(size_t c = 0; c < cache.size(); c++) {
+			int v = cache[c];
+			for(int i = 0; i < remaining[v]; i++) {
+				int t = adjacency[offsets[v] + i];
+				if(triangle_score[t] > best_score) {
+					best = t;
+					best_score = triangle_score[t];
+				}
+			}
+		}
+		if(cache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+			cache.resize(FORSYTH_CACHE_SIZE);
+		}
+	}
+
+	triangles.swap(order);
+}
+
+// Sort clusters of (cache ordered) triangles so those facing away from the
+// mesh centre come first - on convex meshes they hide the rest
+static void optimizeOverdraw(std::vector<glm::ivec3> &triangles, const std::vector<glm::vec4> &buffer, int first_vertex, int stride) {
+	auto position = [&](int v) { return glm::vec3(buffer[(first_vertex + v) * stride]); };
+
+	// Mesh centre
+	glm::vec3 centre(0.0f);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		centre += position(triangles[t].x) + position(triangles[t].y) + position(triangles[t].z);
+	}
+	centre /= 3.0f * triangles.size();
+
+	// Cluster sort key - how far its area weighted normal points away from the centre
+	std::vector< std::pair<float, int> > clusters;
+	for(size_t begin = 0; begin < triangles.size(); begin += OVERDRAW_CLUSTER) {
+		size_t end = std::min(triangles.size(), begin + OVERDRAW_CLUSTER);
+		glm::vec3 cluster_centre(0.0f), normal(0.0f);
+		for(size_t t = begin; t < end; t++) {
+			glm::vec3 a = position(triangles[t].x), b = position(triangles[t].y), c = position(triangles[t].z);
+			cluster_centre += a + b + c;
+			normal += glm::cross(b - a, c - a);
+		}
+		cluster_centre /= 3.0f * (end - begin);
+		float length = glm::length(normal);
+		float facing = length > 0.0f ? glm::dot(cluster_centre - centre, normal / length) : 0.0f;
+		clusters.push_back(std::make_pair(-facing, (int)begin));
+	}
+	std::stable_sort(clusters.begin(), clusters.end());
+
+	std::vector<glm::ivec3> order;
+	order.reserve(triangles.size());
+	for(size_t c = 0; c < clusters.size(); c++) {
+		size_t begin = clusters[c].second;
+		size_t end = std::min(triangles.size(), begin + OVERDRAW_CLUSTER);
+		order.insert(order.end(), triangles.begin() + begin, triangles.begin() + end);
+	}
+	triangles.swap(order);
+}
+
+// Optimise every level for the GPU
+void optimizeMesh(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, std::vector<MeshLevel> &levels, int stride, bool overdraw) {
+	for(size_t l = 0; l < levels.size(); l++) {
+		const MeshLevel &level = levels[l];
+
+		// Triangles with level-local vertex numbers
+		std::vector<glm::ivec3> triangles(indexes.begin() + level.first_triangle, indexes.begin() + level.first_triangle + level.triangles);
+		for(size_t t = 0; t < triangles.size(); t++) {
+			triangles[t] -= glm::ivec3(level.first_vertex);
+		}
+
+		optimizeVertexCache(triangles, level.vertices);
+		if(overdraw) {
+			optimizeOverdraw(triangles, buffer, level.first_vertex, stride);
+		}
+
+		// Renumber vertices in order of first use (unused ones go last)
+		std::vector<int> remap(level.vertices, -1);
+		int next = 0;
+		for(size_t t = 0; t < triangles.size(); t++) {
+			for(int k = 0; k < 3; k++) {
+				int &v = triangles[t][k];
+				if(remap[v] < 0) {
+					remap[v] = next++;
+				}
+				v = remap[v];
+			}
+		}
+		std::vector<glm::vec4> vertices(buffer.begin() + level.first_vertex * stride, buffer.begin() + (level.first_vertex + level.vertices) * stride);
+		for(int v = 0; v < level.vertices; v++) {
+			if(remap[v] < 0) {
+				remap[v] = next++;
+			}
+			std::copy(vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride, buffer.begin() + (level.first_vertex + remap[v]) * stride);
+		}
+
+		for(size_t t = 0; t < triangles.size(); t++) {
+			indexes[level.first_triangle + t] = triangles[t] + glm::ivec3(level.first_vertex);
+		}
+	}
+}
+
+// Optimise a whole mesh (one level)
+void optimizeMesh(std::vector<glm::vec4> &buffer, std::vector<glm::ivec3> &indexes, int stride, bool overdraw) {
+	std::vector<MeshLevel> levels(1, wholeMesh(buffer.size() / stride, indexes.size()));
+	optimizeMesh(buffer, indexes, levels, stride, overdraw);
+}
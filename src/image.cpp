@@ -199,4 +199,132 @@ GLuint loadTextureCubeMap(const char *filename[6], int &width, int &height, int
 	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
 	return texture;
-}
\ No newline at end of file
+}
+
+// Resample an image to a new size (bilinear)
+void resampleImage(const unsigned char *src, int src_width, int src_height, unsigned char *dst, int dst_width, int dst_height, int n) {
+	// Scale from destination to source pixel centres
+	float scale_x = (float)src_width / dst_width;
+	float scale_y = (float)src_height / dst_height;
+
+	for(int iy = 0; iy < dst_height; iy++) {
+		// Source row pair and weight
+		float fy = glm::clamp((iy + 0.5f) * scale_y - 0.5f, 0.0f, (float)(src_height - 1));
+		int y0 = (int)fy;
+		int y1 = glm::min(y0 + 1, src_height - 1);
+		float wy = fy - y0;
+
+		for(int ix = 0; ix < dst_width; ix++) {
+			// Source column pair and weight
+			float fx = glm::clamp((ix + 0.5f) * scale_x - 0.5f, 0.0f, (float)(src_width - 1));
+			int x0 = (int)fx;
+			int x1 = glm::min(x0 + 1, src_width - 1);
+			float wx = fx - x0;
+
+			// Blend the four neighbouring texels
+			for(int c = 0; c < n; c++) {
+				float top    = src[(y0*src_width + x0)*n + c] * (1.0f - wx) + src[(y0*src_width + x1)*n + c] * wx;
+				float bottom = src[(y1*src_width + x0)*n + c] * (1.0f - wx) + src[(y1*src_width + x1)*n + c] * wx;
+				dst[(iy*dst_width + ix)*n + c] = (unsigned char)(top * (1.0f - wy) + bottom * wy + 0.5f);
+			}
+		}
+	}
+}
+
+// Load a 2D Texture Array from files (one layer per file, resampled to width x height)
+GLuint loadTexture2DArray(const char *filename[], int count, int &width, int &height, int &n, bool flip) {
+	// Common layer size (0 - use the first image size)
+	int layer_width = width;
+	int layer_height = height;
+
+	// Texture
+	GLuint texture;
+
+	// Generate texture
+	glGenTextures(1, &texture);
+
+	// Bind texture
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+	// Resample buffer
+	unsigned char *resampled = NULL;
+
+	// Load layers
+	for(int i = 0; i < count; i++) {
+		// Load image from file
+		int image_width, image_height;
+		unsigned char *image = loadImage(filename[i], image_width, image_height, n, flip);
+
+		// Check image result
+		if(image == NULL) {
+			continue;
+		}
+
+		// Allocate storage for every layer on the first image
+		if(resampled == NULL) {
+			if(layer_width <= 0 || layer_height <= 0) {
+				layer_width = image_width;
+				layer_height = image_height;
+			}
+
+			// ------------------------------
+			// Mip-Mapping
+			// ------------------------------
+			// Full mip chain - 1 + log_2(largest dimension)
+			int max_levels = 1 + (int)glm::log2((float)glm::max(layer_width, layer_height));
+
+			// Set storage
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, max_levels, GL_RGBA8, layer_width, layer_height, count);
+
+			// Allocate resample buffer
+			resampled = new unsigned char[layer_width*layer_height*n];
+		}
+
+		// Resample image to the layer size if required
+		unsigned char *layer = image;
+		if(image_width != layer_width || image_height != layer_height) {
+			resampleImage(image, image_width, image_height, resampled, layer_width, layer_height, n);
+			layer = resampled;
+		}
+
+		// Copy image data into layer i
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, layer_width, layer_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer);
+
+		// Delete image data
+		delete[] image;
+	}
+
+	// Delete resample buffer
+	delete[] resampled;
+
+	// Generate Mipmap
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	// Configure texture
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Configure Texture Coordinate Wrapping - body maps wrap around in u (sphere
+	// seam vertices go past 1) and stop at the poles in v
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// ------------------------------
+	// Anistropic Filtering
+	// ------------------------------
+	// Get Maximum Anistropic level
+	GLfloat maxAnistropy = 0.0f;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnistropy);
+
+	// Enable Anistropic Filtering
+	glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnistropy);
+
+	// Unbind texture
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Report layer size
+	width = layer_width;
+	height = layer_height;
+
+	return texture;
+}
@@ -0,0 +1,250 @@
+// System Headers
+#include <algorithm>
+
+// Project Headers
+#include "jobs.h"
+
+// Caller deque slots in use
+struct JobCallerSlots {
+	std::mutex mutex;
+	bool used[JobSystem::MAX_CALLERS];
+
+	JobCallerSlots() {
+		std::fill(used, used + JobSystem::MAX_CALLERS, false);
+	}
+};
+
+// Caller slot held by a thread - freed when the thread exits or moves to
+// another job system (the slots outlive a job system destroyed first)
+struct CallerRegistration {
+	std::weak_ptr<JobCallerSlots> slots;
+	int index;
+
+	CallerRegistration() : index(0) {}
+	~CallerRegistration() { release(); }
+
+	void release() {
+		std::shared_ptr<JobCallerSlots> held = slots.lock();
+		if(held) {
+			std::lock_guard<std::mutex> lock(held->mutex);
+			held->used[index] = false;
+		}
+		slots.reset();
+	}
+};
+
+// Serial number of every job system (0 is none)
+static std::atomic<unsigned long> next_serial(1);
+
+// Job system the calling thread last ran in, the index of its deque there and its caller slot
+static thread_local unsigned long thread_serial = 0;
+static thread_local int thread_index = 0;
+static thread_local CallerRegistration thread_caller;
+
+// --------------------------------------------------------------------------------
+// Job System
+// --------------------------------------------------------------------------------
+// Constructor
+JobSystem::JobSystem(int workers) : mCallers(std::make_shared<JobCallerSlots>()), mSerial(next_serial.fetch_add(1)), mQueued(0), mSleepers(0), mStop(false) {
+	// One worker per extra hardware thread by default
+	if(workers < 0) {
+		int threads = (int)std::thread::hardware_concurrency();
+		workers = threads > 1 ? threads - 1 : 0;
+	}
+
+	// Deques for the callers and every worker
+	for(int i = 0; i < MAX_CALLERS + workers; i++) {
+		mQueues.push_back(new Queue());
+	}
+
+	// Start workers
+	for(int i = 0; i < workers; i++) {
+		mWorkers.push_back(std::thread(&JobSystem::workerLoop, this, MAX_CALLERS + i));
+	}
+}
+
+JobSystem::~JobSystem() {
+	// Stop and join workers
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+	for(size_t i = 0; i < mWorkers.size(); i++) {
+		mWorkers[i].join();
+	}
+
+	// Delete deques
+	for(size_t i = 0; i < mQueues.size(); i++) {
+		delete mQueues[i];
+	}
+}
+
+// Run a parallel-for
+void JobSystem::run(size_t count, size_t grain, RangeFunction function, const void *data) {
+	if(count == 0) {
+		return;
+	}
+	if(grain == 0) {
+		grain = 1;
+	}
+
+	// Small ranges (or no workers) are not worth waking anyone for
+	if(count <= grain || mWorkers.empty()) {
+		runSerial(count, grain, function, data);
+		return;
+	}
+
+	// Every caller needs its own deque
+	int thread = getThreadIndex();
+	if(thread < 0) {
+		runSerial(count, grain, function, data);
+		return;
+	}
+
+	// Items still to run - the job is done when this reaches zero
+	std::atomic<size_t> remaining(count);
+
+	Job job;
+	job.function = function;
+	job.data = data;
+	job.begin = 0;
+	job.end = count;
+	job.grain = grain;
+	job.remaining = &remaining;
+	execute(thread, job);
+
+	// Help with the rest of this job only - other callers' jobs would hold this
+	// one up (the pieces left are all being run, or waiting in a deque)
+	while(remaining.load(std::memory_order_acquire) > 0) {
+		Job next;
+		if(pop(thread, next, &remaining) || steal(thread, next, &remaining)) {
+			execute(thread, next);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+// Run a range on the calling thread in chunks of at most grain
+void JobSystem::runSerial(size_t count, size_t grain, RangeFunction function, const void *data) {
+	for(size_t begin = 0; begin < count; begin += grain) {
+		function(data, begin, std::min(count, begin + grain));
+	}
+}
+
+// Split a job down to the grain then run it
+void JobSystem::execute(int thread, Job job) {
+	// Keep the first half, offer the second half to other threads
+	while(job.end - job.begin > job.grain) {
+		Job half = job;
+		half.begin = job.begin + (job.end - job.begin) / 2;
+		job.end = half.begin;
+		push(thread, half);
+	}
+
+	job.function(job.data, job.begin, job.end);
+	job.remaining->fetch_sub(job.end - job.begin, std::memory_order_release);
+}
+
+// Deque of the calling thread
+int JobSystem::getThreadIndex() {
+	if(thread_serial == mSerial) {
+		return thread_index;
+	}
+
+	// First call from this thread (or it last ran in another job system) -
+	// give up any slot held elsewhere and claim a free one
+	thread_caller.release();
+	int index = -1;
+	{
+		std::lock_guard<std::mutex> lock(mCallers->mutex);
+		for(int i = 0; i < MAX_CALLERS && index < 0; i++) {
+			if(!mCallers->used[i]) {
+				mCallers->used[i] = true;
+				index = i;
+			}
+		}
+	}
+	if(index < 0) {
+		return -1;
+	}
+
+	thread_caller.slots = mCallers;
+	thread_caller.index = index;
+	thread_serial = mSerial;
+	thread_index = index;
+	return index;
+}
+
+// Push to the back of a thread's deque
+void JobSystem::push(int thread, const Job &job) {
+	// Count first so a thief taking the job straight away never takes the count below zero
+	mQueued.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(mQueues[thread]->mutex);
+		mQueues[thread]->jobs.push_back(job);
+	}
+
+	// Wake a worker only if one is asleep - a worker counts itself as a sleeper
+	// before checking mQueued, so either it sees this job or this sees it
+	if(mSleepers.load() > 0) {
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mWake.notify_one();
+	}
+}
+
+// Pop from the back of a thread's deque (most recently split - still in cache)
+bool JobSystem::pop(int thread, Job &job, const std::atomic<size_t> *remaining) {
+	std::lock_guard<std::mutex> lock(mQueues[thread]->mutex);
+	std::deque<Job> &jobs = mQueues[thread]->jobs;
+	if(jobs.empty() || (remaining != NULL && jobs.back().remaining != remaining)) {
+		return false;
+	}
+	job = jobs.back();
+	jobs.pop_back();
+	mQueued.fetch_sub(1);
+	return true;
+}
+
+// Steal from the front of another thread's deque (largest piece)
+bool JobSystem::steal(int thread, Job &job, const std::atomic<size_t> *remaining) {
+	int count = (int)mQueues.size();
+	for(int i = 1; i < count; i++) {
+		Queue *victim = mQueues[(thread + i) % count];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		for(std::deque<Job>::iterator it = victim->jobs.begin(); it != victim->jobs.end(); ++it) {
+			if(remaining == NULL || it->remaining == remaining) {
+				job = *it;
+				victim->jobs.erase(it);
+				mQueued.fetch_sub(1);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Worker thread
+void JobSystem::workerLoop(int thread) {
+	thread_serial = mSerial;
+	thread_index = thread;
+
+	while(true) {
+		// Run own jobs first, then steal
+		Job job;
+		if(pop(thread, job) || steal(thread, job)) {
+			execute(thread, job);
+			continue;
+		}
+
+		// Sleep until more jobs are pushed
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleepers.fetch_add(1);
+		mWake.wait(lock, [this] { return mStop || mQueued.load() > 0; });
+		mSleepers.fetch_sub(1);
+		if(mStop) {
+			break;
+		}
+	}
+}
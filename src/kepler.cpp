@@ -0,0 +1,164 @@
+// Project Headers
+#include "kepler.h"
+#include "transforms.h"
+#include "simd.h"
+
+// --------------------------------------------------------------------------------
+// Kepler Orbits
+// --------------------------------------------------------------------------------
+// Orbit plane basis scaled by the orbit size
+void orbitBasis(const OrbitalElements &elements, float P[3], float Q[3]) {
+	double cosNode = cos(elements.node), sinNode = sin(elements.node);
+	double cosPeri = cos(elements.periapsis), sinPeri = sin(elements.periapsis);
+	double cosInc = cos(elements.inclination), sinInc = sin(elements.inclination);
+
+	// Unit vectors towards periapsis and 90 degrees ahead of it, in a Z-up reference frame
+	double p[3] = {cosNode*cosPeri - sinNode*sinPeri*cosInc, sinNode*cosPeri + cosNode*sinPeri*cosInc, sinPeri*sinInc};
+	double q[3] = {-cosNode*sinPeri - sinNode*cosPeri*cosInc, -sinNode*sinPeri + cosNode*cosPeri*cosInc, cosPeri*sinInc};
+
+	// Scale by the semi-major and semi-minor axes
+	double e = elements.eccentricity;
+	double a = elements.semi_major;
+	double b = a * sqrt(1.0 - e*e);
+
+	// Z-up (x, y, z) is world (x, z, -y)
+	P[0] = (float)(a * p[0]);  P[1] = (float)(a * p[2]);  P[2] = (float)(-a * p[1]);
+	Q[0] = (float)(b * q[0]);  Q[1] = (float)(b * q[2]);  Q[2] = (float)(-b * q[1]);
+}
+
+// Solve Kepler's equation for the eccentric anomaly
+float solveKepler(float M, float e) {
+	// Starting guess (second order series in e)
+	float E = M + e * sinf(M) * (1.0f + e * cosf(M));
+
+	// Fixed number of Halley steps - no convergence test, so every body costs the same
+	for(int i = 0; i < KEPLER_ITERATIONS; i++) {
+		float sinE = sinf(E);
+		float cosE = cosf(E);
+		float f   = E - e * sinE - M;
+		float df  = 1.0f - e * cosE;
+		float d2f = e * sinE;
+		E -= f / (df - 0.5f * f * d2f / df);
+	}
+
+	return E;
+}
+
+// Scalar kernel
+static void solveOrbitsScalar(const float *M, const float *e,
+                              const float *px, const float *py, const float *pz,
+                              const float *qx, const float *qy, const float *qz,
+                              float *x, float *y, float *z, size_t count) {
+	for(size_t i = 0; i < count; i++) {
+		float E = solveKepler(M[i], e[i]);
+		float u = cosf(E) - e[i];
+		float v = sinf(E);
+
+		x[i] = px[i] * u + qx[i] * v;
+		y[i] = py[i] * u + qy[i] * v;
+		z[i] = pz[i] * u + qz[i] * v;
+	}
+}
+
+#if defined(SIMD_X86)
+// SSE2 kernel - 4 bodies per iteration, same steps as solveKepler
+static void solveOrbitsSSE2(const float *M, const float *e,
+                            const float *px, const float *py, const float *pz,
+                            const float *qx, const float *qy, const float *qz,
+                            float *x, float *y, float *z, size_t count) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 m = _mm_loadu_ps(&M[i]);
+		__m128 ecc = _mm_loadu_ps(&e[i]);
+
+		// Starting guess
+		__m128 s, c;
+		sincos4(m, s, c);
+		__m128 E = _mm_add_ps(m, _mm_mul_ps(_mm_mul_ps(ecc, s), _mm_add_ps(one, _mm_mul_ps(ecc, c))));
+
+		// Halley steps
+		for(int k = 0; k < KEPLER_ITERATIONS; k++) {
+			sincos4(E, s, c);
+			__m128 f   = _mm_sub_ps(_mm_sub_ps(E, _mm_mul_ps(ecc, s)), m);
+			__m128 df  = _mm_sub_ps(one, _mm_mul_ps(ecc, c));
+			__m128 d2f = _mm_mul_ps(ecc, s);
+			__m128 denominator = _mm_sub_ps(df, _mm_div_ps(_mm_mul_ps(_mm_mul_ps(half, f), d2f), df));
+			E = _mm_sub_ps(E, _mm_div_ps(f, denominator));
+		}
+
+		// Position
+		sincos4(E, s, c);
+		__m128 u = _mm_sub_ps(c, ecc);
+		_mm_storeu_ps(&x[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&px[i]), u), _mm_mul_ps(_mm_loadu_ps(&qx[i]), s)));
+		_mm_storeu_ps(&y[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&py[i]), u), _mm_mul_ps(_mm_loadu_ps(&qy[i]), s)));
+		_mm_storeu_ps(&z[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pz[i]), u), _mm_mul_ps(_mm_loadu_ps(&qz[i]), s)));
+	}
+
+	// Remaining bodies
+	solveOrbitsScalar(&M[i], &e[i], &px[i], &py[i], &pz[i], &qx[i], &qy[i], &qz[i], &x[i], &y[i], &z[i], count - i);
+}
+
+// AVX2 kernel - 8 bodies per iteration
+__attribute__((target("avx2")))
+static void solveOrbitsAVX2(const float *M, const float *e,
+                            const float *px, const float *py, const float *pz,
+                            const float *qx, const float *qy, const float *qz,
+                            float *x, float *y, float *z, size_t count) {
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 m = _mm256_loadu_ps(&M[i]);
+		__m256 ecc = _mm256_loadu_ps(&e[i]);
+
+		// Starting guess
+		__m256 s, c;
+		sincos8(m, s, c);
+		__m256 E = _mm256_add_ps(m, _mm256_mul_ps(_mm256_mul_ps(ecc, s), _mm256_add_ps(one, _mm256_mul_ps(ecc, c))));
+
+		// Halley steps
+		for(int k = 0; k < KEPLER_ITERATIONS; k++) {
+			sincos8(E, s, c);
+			__m256 f   = _mm256_sub_ps(_mm256_sub_ps(E, _mm256_mul_ps(ecc, s)), m);
+			__m256 df  = _mm256_sub_ps(one, _mm256_mul_ps(ecc, c));
+			__m256 d2f = _mm256_mul_ps(ecc, s);
+			__m256 denominator = _mm256_sub_ps(df, _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(half, f), d2f), df));
+			E = _mm256_sub_ps(E, _mm256_div_ps(f, denominator));
+		}
+
+		// Position
+		sincos8(E, s, c);
+		__m256 u = _mm256_sub_ps(c, ecc);
+		_mm256_storeu_ps(&x[i], _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&px[i]), u), _mm256_mul_ps(_mm256_loadu_ps(&qx[i]), s)));
+		_mm256_storeu_ps(&y[i], _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&py[i]), u), _mm256_mul_ps(_mm256_loadu_ps(&qy[i]), s)));
+		_mm256_storeu_ps(&z[i], _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&pz[i]), u), _mm256_mul_ps(_mm256_loadu_ps(&qz[i]), s)));
+	}
+
+	// Remaining bodies
+	solveOrbitsSSE2(&M[i], &e[i], &px[i], &py[i], &pz[i], &qx[i], &qy[i], &qz[i], &x[i], &y[i], &z[i], count - i);
+}
+#endif // SIMD_X86
+
+// Positions of count bodies with the selected kernel
+void solveOrbits(const float *mean_anomaly, const float *eccentricity,
+                 const float *px, const float *py, const float *pz,
+                 const float *qx, const float *qy, const float *qz,
+                 float *x, float *y, float *z, size_t count) {
+	switch(getTransformKernel()) {
+#if defined(SIMD_X86)
+		case TRANSFORM_AVX2:
+			solveOrbitsAVX2(mean_anomaly, eccentricity, px, py, pz, qx, qy, qz, x, y, z, count);
+			break;
+		case TRANSFORM_SSE2:
+			solveOrbitsSSE2(mean_anomaly, eccentricity, px, py, pz, qx, qy, qz, x, y, z, count);
+			break;
+#endif
+		default:
+			solveOrbitsScalar(mean_anomaly, eccentricity, px, py, pz, qx, qy, qz, x, y, z, count);
+			break;
+	}
+}
@@ -2,6 +2,13 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <chrono>
 
 // OpenGL Headers
 #if defined(_WIN32)
@@ -39,12 +46,21 @@
 #include "image.h"
 #include "camera.h"
 #include "transforms.h"
+#include "render_state.h"
+#include "capture.h"
+#include "simulation.h"
+#include "bodies.h"
+#include "nbody.h"
+#include "simulation_thread.h"
 
 using namespace std;
 
 // Camera
 Camera *camera;
 
+// Simulation Clock (fixed step, independent of frame rate)
+SimulationClock simulation_clock;
+
 // --------------------------------------------------------------------------------
 // GLFW Callbacks
 // --------------------------------------------------------------------------------
@@ -82,84 +98,252 @@ void onCursorPosition(GLFWwindow *window, double x, double y) {
 	camera->onCursorPosition(window, x, y);
 }
 
+// --------------------------------------------------------------------------------
+// Keyboard Input
+// --------------------------------------------------------------------------------
+void onKey(GLFWwindow *window, int key, int scancode, int action, int mods) {
+	if(action != GLFW_PRESS) {
+		return;
+	}
+
+	// P - Pause / Resume simulation
+	if(key == GLFW_KEY_P) {
+		simulation_clock.setPaused(!simulation_clock.isPaused());
+		std::cout << (simulation_clock.isPaused() ? "Paused" : "Resumed") << std::endl;
+	}
+
+	// = / - Speed up / slow down simulation
+	if(key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS) {
+		double scale = simulation_clock.getTimeScale() * (key == GLFW_KEY_EQUAL ? 2.0 : 0.5);
+		simulation_clock.setTimeScale(scale);
+		std::cout << "Time scale: " << scale << "x" << std::endl;
+	}
+}
+
+// Radius of a size 1.0 body (the sphere mesh has unit radius)
+const float BODY_SCALE = 0.1f;
+
+// Degrees to radians for the orbital elements below
+const float DEG = 3.14159265f / 180.0f;
+
 //order goes distrance from sun starting at sun
 //Sun, mercury,venus, earth, mars, jupiter, saturn, uranus, neptune
 //I have tripled the size of the planets (not the sun) to make it more visible
-const float PLANET_SIZES[9] =
+//every body spins around its own axis at 0.5 radians per second
+//eccentricity, inclination, node and periapsis are the real (J2000) values
+const BodyDesc SOLAR_SYSTEM[] =
 {
-    1.0f,
-    0.00349f*5,
-    0.00866f*5,
-    0.00912f*5,
-    0.00485f*5,
-    0.10f*5,
-    0.08f*5,
-    0.0363f*5,
-    0.03525f*5
+    // texture                            radius                   a      e       i            node          periapsis     M0      n         spin  parent
+    {"./images/planets/sunmap.jpg",       1.0f*BODY_SCALE,        {0.00f, 0.000f, 0.00f*DEG,   0.0f*DEG,     0.0f*DEG,     0.0f,   0.00f},   0.5f, -1},
+    {"./images/planets/mercurymap.jpg",   0.00349f*5*BODY_SCALE,  {0.32f, 0.206f, 7.00f*DEG,   48.3f*DEG,    29.1f*DEG,    10.0f,  0.10f},   0.5f, -1},
+    {"./images/planets/venusmap.jpg",     0.00866f*5*BODY_SCALE,  {0.64f, 0.007f, 3.39f*DEG,   76.7f*DEG,    54.9f*DEG,    54.0f,  0.09f},   0.5f, -1},
+    {"./images/planets/earthmap.jpg",     0.00912f*5*BODY_SCALE,  {0.96f, 0.017f, 0.00f*DEG,   348.7f*DEG,   114.2f*DEG,   32.0f,  0.08f},   0.5f, -1},
+    {"./images/planets/marsmap.jpg",      0.00485f*5*BODY_SCALE,  {1.28f, 0.093f, 1.85f*DEG,   49.6f*DEG,    286.5f*DEG,   90.0f,  0.07f},   0.5f, -1},
+    {"./images/planets/jupitermap.jpg",   0.10f*5*BODY_SCALE,     {1.60f, 0.049f, 1.30f*DEG,   100.5f*DEG,   273.9f*DEG,   140.0f, 0.06f},   0.5f, -1},
+    {"./images/planets/saturnmap.jpg",    0.08f*5*BODY_SCALE,     {1.92f, 0.057f, 2.49f*DEG,   113.7f*DEG,   339.4f*DEG,   20.0f,  0.05f},   0.5f, -1},
+    {"./images/planets/uranusmap.jpg",    0.0363f*5*BODY_SCALE,   {2.24f, 0.046f, 0.77f*DEG,   74.0f*DEG,    96.9f*DEG,    66.0f,  0.04f},   0.5f, -1},
+    {"./images/planets/neptunemap.jpg",   0.03525f*5*BODY_SCALE,  {2.56f, 0.010f, 1.77f*DEG,   131.8f*DEG,   273.2f*DEG,   88.0f,  0.03f},   0.5f, -1}
 };
 
-const float PLANET_SPEED[9] =
-{
-    0.0f,
-    0.1f,
-    0.09f,
-    0.08f,
-    0.07f,
-    0.06f,
-    0.05f,
-    0.04f,
-    0.03f,
+// Asteroid belt for N-body mode (--particles) - between Mars and Jupiter,
+// orbiting the sun's mass (G = 1) at about the speed of the planets around it
+const float SUN_MASS           = 0.013f;
+const float BELT_INNER         = 1.36f;
+const float BELT_OUTER         = 1.52f;
+const float BELT_THICKNESS     = 0.04f;
+const float BELT_MASS          = 1e-4f;
+const float PARTICLE_SOFTENING = 0.005f;
+const float PARTICLE_THETA     = 0.5f;
+const float PARTICLE_RADIUS    = 0.002f;
+
+// Particles per job when filling the impostor buffer
+const size_t IMPOSTOR_GRAIN = 16384;
+
+// Common size of every layer in the body texture array
+const int TEXTURE_ARRAY_WIDTH  = 1024;
+const int TEXTURE_ARRAY_HEIGHT = 512;
+
+// Sphere levels of detail - icosphere subdivided 4 (5120 triangles) down to 0 times (20),
+// or a cube sphere with these subdivisions per edge (4800 down to 12 triangles)
+const bool USE_CUBE_SPHERE = false;
+const int SPHERE_LOD_LEVELS = 5;
+const int CUBE_SPHERE_SUBDIVISIONS[SPHERE_LOD_LEVELS] = {20, 10, 5, 2, 1};
+
+// Level of detail selection - bodies smaller than LOD_MIN_RADIUS pixels are drawn
+// as impostors, and switching to a coarser level needs a LOD_HYSTERESIS margin
+const float LOD_MIN_RADIUS = 3.0f;
+const float LOD_HYSTERESIS = 0.2f;
+
+// Draw every planet (not the sun) with a single instanced draw call
+const bool USE_INSTANCING = true;
+
+// Sphere meshes as 16 byte PackedVertex instead of three vec4 (48 bytes)
+const bool USE_PACKED_VERTICES = true;
+
+// Sphere levels as triangle strips (split by primitive restart) instead of lists -
+// a third of the indexes, but cache optimised lists transform fewer vertices
+const bool USE_TRIANGLE_STRIPS = false;
+
+// Sort sphere triangles in outward facing clusters (less overdraw, slightly more cache misses)
+const bool USE_OVERDRAW_SORT = false;
+
+// Vertex attribute locations (must match layout qualifiers in the shaders)
+const GLuint SPHERE_POSITION_LOC = 0;
+const GLuint SPHERE_NORMAL_LOC   = 1;
+const GLuint SPHERE_UV_LOC       = 2;
+const GLuint INSTANCE_MODEL_LOC  = 3; // mat4 - locations 3 to 6
+const GLuint INSTANCE_LAYER_LOC  = 7;
+const GLuint IMPOSTOR_CENTRE_LOC  = 0; // vec4 - centre and radius
+const GLuint IMPOSTOR_LAYER_LOC   = 1;
+
+// Uniform block binding point for FrameData
+const GLuint FRAME_DATA_BINDING = 0;
+
+// Per-frame state (std140 layout - must match FrameData in shader/*.vert.glsl)
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 orientation;
+    glm::vec4 light;
+    float time;
+    float pad[3];
 };
 
-const float PLANET_START_LOC[9] =
-{
-    0.0f,
-    10.0f,
-    54.0f,
-    32.0f,
-    90.0f,
-    140.0f,
-    20.0f,
-    66.0f,
-    88.0f
+// Command line options
+struct Options {
+    bool headless;   // --headless        render offscreen (EGL, no window) and exit
+    int width;       // --size WxH        framebuffer size
+    int height;
+    int frames;      // --frames N        frames to render in headless mode
+    string capture;  // --capture PREFIX  write every frame to PREFIX<frame>.<ext>
+    CaptureFormat capture_format; // --capture-format png|ppm|raw
+    double time_scale; // --time-scale X   simulation seconds per real second
+    int jobs;        // --jobs N          worker threads for body updates (-1 = one per extra core)
+    int particles;   // --particles N     N-body asteroid belt particles (0 = off)
+    float lod_error; // --lod-error PX    largest sphere level of detail error on screen (0 = always finest)
 };
 
-const string PLANET_TEXTURE[9] =
-{
-    "./images/planets/sunmap.jpg",
-    "./images/planets/mercurymap.jpg",
-    "./images/planets/venusmap.jpg",
-    "./images/planets/earthmap.jpg",
-    "./images/planets/marsmap.jpg",
-    "./images/planets/jupitermap.jpg",
-    "./images/planets/saturnmap.jpg",
-    "./images/planets/uranusmap.jpg",
-    "./images/planets/neptunemap.jpg"
-};
+// Parse command line (returns false on bad arguments)
+bool parseOptions(int argc, char **argv, Options &options) {
+    // Defaults
+    options.headless = false;
+    options.width = 600;
+    options.height = 600;
+    options.frames = 100;
+    options.capture_format = CAPTURE_PNG;
+    options.time_scale = 1.0;
+    options.jobs = -1;
+    options.particles = 0;
+    options.lod_error = 0.5f;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if(arg == "--headless") {
+            options.headless = true;
+        } else if(arg == "--size" && i + 1 < argc) {
+            if(sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0) {
+                std::cerr << "Error: --size expects WIDTHxHEIGHT" << std::endl;
+                return false;
+            }
+        } else if(arg == "--frames" && i + 1 < argc) {
+            options.frames = atoi(argv[++i]);
+            if(options.frames <= 0) {
+                std::cerr << "Error: --frames expects a positive count" << std::endl;
+                return false;
+            }
+        } else if(arg == "--time-scale" && i + 1 < argc) {
+            options.time_scale = atof(argv[++i]);
+        } else if(arg == "--jobs" && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+            if(options.jobs < 0) {
+                std::cerr << "Error: --jobs expects a worker count (0 runs everything on the render thread)" << std::endl;
+                return false;
+            }
+        } else if(arg == "--particles" && i + 1 < argc) {
+            options.particles = atoi(argv[++i]);
+            if(options.particles < 0) {
+                std::cerr << "Error: --particles expects a particle count" << std::endl;
+                return false;
+            }
+        } else if(arg == "--lod-error" && i + 1 < argc) {
+            options.lod_error = atof(argv[++i]);
+            if(options.lod_error < 0.0f) {
+                std::cerr << "Error: --lod-error expects a pixel error (0 or more)" << std::endl;
+                return false;
+            }
+        } else if(arg == "--capture" && i + 1 < argc) {
+            options.capture = argv[++i];
+        } else if(arg == "--capture-format" && i + 1 < argc) {
+            if(!parseCaptureFormat(argv[++i], options.capture_format)) {
+                std::cerr << "Error: --capture-format expects png, ppm or raw" << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--headless] [--size WxH] [--frames N] [--capture PREFIX] [--capture-format png|ppm|raw] [--time-scale X] [--jobs N] [--particles N] [--lod-error PX]" << std::endl;
+            return false;
+        }
+    }
 
-int main() {
-	// Set Error Callback
-	glfwSetErrorCallback(onError);
+    return true;
+}
+
+// Point the sphere attributes at the bound vertex buffer (float or packed layout)
+void setSphereAttributes() {
+	if(USE_PACKED_VERTICES) {
+		glVertexAttribPointer(SPHERE_POSITION_LOC, 4, GL_SHORT,          GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+		glVertexAttribPointer(SPHERE_NORMAL_LOC,   2, GL_SHORT,          GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(SPHERE_UV_LOC,       2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, uv));
+	} else {
+		glVertexAttribPointer(SPHERE_POSITION_LOC, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), NULL);
+		glVertexAttribPointer(SPHERE_NORMAL_LOC,   4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), (GLvoid*)(4*sizeof(float)));
+		glVertexAttribPointer(SPHERE_UV_LOC,       4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), (GLvoid*)(8*sizeof(float)));
+	}
+	glEnableVertexAttribArray(SPHERE_POSITION_LOC);
+	glEnableVertexAttribArray(SPHERE_NORMAL_LOC);
+	glEnableVertexAttribArray(SPHERE_UV_LOC);
+}
 
-	// Initialise GLFW
-	if (!glfwInit()) {
-		// Return Error
+int main(int argc, char **argv) {
+	// Parse command line
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
 		return 1;
 	}
 
-	// Set GLFW Window Hint - Full-Screen Antialiasing 16x
-	glfwWindowHint(GLFW_SAMPLES, 16);
+	GLFWwindow *window = NULL;
+	HeadlessContext headless;
 
-	// Create Window
-	GLFWwindow *window = createWindow(600, 600, "Assignment 3", 3, 2);
+	if (options.headless) {
+		// Create offscreen context (software rasteriser when there is no GPU)
+		if (!createHeadlessContext(headless, 3, 2)) {
+			// Return Error
+			return 1;
+		}
+	} else {
+		// Set Error Callback
+		glfwSetErrorCallback(onError);
 
-	// Check Window
-	if (window == NULL) {
-		// Print Error Message
-		std::cerr << "Error: create window or context failed." << std::endl;
+		// Initialise GLFW
+		if (!glfwInit()) {
+			// Return Error
+			return 1;
+		}
 
-		// Return Error
-		return 1;
+		// Set GLFW Window Hint - Full-Screen Antialiasing 16x
+		glfwWindowHint(GLFW_SAMPLES, 16);
+
+		// Create Window
+		window = createWindow(options.width, options.height, "Assignment 3", 3, 2);
+
+		// Check Window
+		if (window == NULL) {
+			// Print Error Message
+			std::cerr << "Error: create window or context failed." << std::endl;
+
+			// Return Error
+			return 1;
+		}
 	}
 
 	#if defined(_WIN32)
@@ -171,25 +355,45 @@ int main() {
 	#endif
     #if defined(__linux__)
         glewExperimental = true;
-        if(glewInit() != GLEW_OK){
+        GLenum glew_status = glewInit();
+        #if defined(GLEW_ERROR_NO_GLX_DISPLAY)
+            // GL entry points are loaded even when there is no GLX display (EGL)
+            if(options.headless && glew_status == GLEW_ERROR_NO_GLX_DISPLAY){
+                glew_status = GLEW_OK;
+            }
+        #endif
+        if(glew_status != GLEW_OK){
             return 1;
         }
     #endif // defined
 
-    //CONST VARS
-    const int NUM_SPHERES = 9;
+	// Offscreen render target for headless mode
+	GLuint headless_fbo = 0, headless_colour = 0, headless_depth = 0;
+	if (options.headless) {
+		headless_fbo = createFramebuffer(options.width, options.height, headless_colour, headless_depth);
+		if (headless_fbo == 0) {
+			// Return Error
+			return 1;
+		}
+		glViewport(0, 0, options.width, options.height);
+	}
 
 	// Enable multi-sampling - Antialiasing
 	glEnable(GL_MULTISAMPLE);
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-	// Set window callback functions
-	glfwSetFramebufferSizeCallback(window, onFramebufferSize);
-	glfwSetWindowCloseCallback(window, onWindowClose);
+	if (window != NULL) {
+		// Set window callback functions
+		glfwSetFramebufferSizeCallback(window, onFramebufferSize);
+		glfwSetWindowCloseCallback(window, onWindowClose);
 
-	// Set mouse input callback functions
-	glfwSetMouseButtonCallback(window, onMouseButton);
-	glfwSetCursorPosCallback(window, onCursorPosition);
+		// Set mouse input callback functions
+		glfwSetMouseButtonCallback(window, onMouseButton);
+		glfwSetCursorPosCallback(window, onCursorPosition);
+
+		// Set keyboard callback function
+		glfwSetKeyCallback(window, onKey);
+	}
 
 	// ----------------------------------------
 	// Initialise OpenGL
@@ -209,9 +413,27 @@ int main() {
 	// ----------------------------------------
 
 	// Load GLSL Program
-	GLuint skybox_program = loadProgram("./shader/skybox.vert.glsl", NULL, NULL, NULL, "./shader/skybox.frag.glsl");
-    GLuint sphere_program = loadProgram("./shader/planets.vert.glsl", NULL, NULL, NULL, "./shader/planets.frag.glsl");
-    GLuint sun_program = loadProgram("./shader/sun.vert.glsl", NULL, NULL, NULL, "./shader/sun.frag.glsl");
+	Program skybox_program("./shader/skybox.vert.glsl", NULL, NULL, NULL, "./shader/skybox.frag.glsl");
+    Program sphere_program("./shader/planets.vert.glsl", NULL, NULL, NULL, "./shader/planets.frag.glsl");
+    Program sun_program("./shader/sun.vert.glsl", NULL, NULL, NULL, "./shader/sun.frag.glsl");
+    Program instanced_program("./shader/planets_instanced.vert.glsl", NULL, NULL, NULL, "./shader/planets.frag.glsl");
+    Program impostor_program("./shader/impostor.vert.glsl", NULL, NULL, NULL, "./shader/impostor.frag.glsl");
+
+	// Uniform locations (reflected at link time - no string lookups in the render loop)
+	GLint sphere_modelLoc      = sphere_program.getUniformLocation("u_Model");
+	GLint sphere_layerLoc      = sphere_program.getUniformLocation("u_Layer");
+	GLint sun_modelLoc         = sun_program.getUniformLocation("u_Model");
+	GLint sun_layerLoc         = sun_program.getUniformLocation("u_Layer");
+
+	// Per-frame uniform block shared by every program
+	skybox_program.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	sphere_program.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	sun_program.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	instanced_program.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	impostor_program.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+
+	FrameData frame_data;
+	GLuint frame_ubo = createUniformBuffer(sizeof(FrameData), FRAME_DATA_BINDING);
 
 	// Load Texture Map
 	int x, y, n;
@@ -232,118 +454,244 @@ int main() {
     //-------------------------------------------------
     // load sphere textures
     //-------------------------------------------------
+    // Every body goes in the body table - layer i of the texture array for body i
+    const int NUM_BODIES = sizeof(SOLAR_SYSTEM) / sizeof(SOLAR_SYSTEM[0]);
+    BodyTable bodies;
+    bodies.reserve(NUM_BODIES);
+
+    // Worker threads for per-body updates (the render thread only consumes results)
+    JobSystem jobs(options.jobs);
+    std::cout << "Job workers: " << jobs.getWorkerCount() << std::endl;
+
+    // Transform hierarchy - every body has an orbit centre node
+    SceneGraph scene;
+    scene.reserve(NUM_BODIES);
+
+    // Every body map is packed into one texture array, resampled to a common
+    // size so it can be bound once for all draws
+    const char *planet_filenames[NUM_BODIES];
+    for(int i = 0; i < NUM_BODIES; i++){
+        planet_filenames[i] = SOLAR_SYSTEM[i].texture;
+        bodies.add(SOLAR_SYSTEM[i], i, scene);
+    }
+
+    // Body transforms are composed in batches (SIMD when supported)
+    std::cout << "Transform kernel: " << getTransformKernelName(getTransformKernel()) << std::endl;
+
+    x = TEXTURE_ARRAY_WIDTH;
+    y = TEXTURE_ARRAY_HEIGHT;
+    GLuint planet_texture_array = loadTexture2DArray(planet_filenames, NUM_BODIES, x, y, n, false);
 
+	//------------------------------------------
+	// Create sphere data and vao
+	//------------------------------------------
+    sphere_program.use();
+	//buffer data - every level of detail in one vertex and index buffer
+    vector<glm::vec4> sphere_buf;
+	vector<glm::ivec3> sphere_indices;
+	vector<MeshLevel> sphere_levels;
 
-    unsigned char *planet_map[9];
-    GLuint sphere_textures[9];
+	if(USE_CUBE_SPHERE) {
+		createCubeSphereLODs(sphere_buf, sphere_indices, sphere_levels, 1.0f, CUBE_SPHERE_SUBDIVISIONS, SPHERE_LOD_LEVELS);
+	} else {
+		createIcosphereLODs(sphere_buf, sphere_indices, sphere_levels, 1.0f, SPHERE_LOD_LEVELS);
+	}
 
-    for(int i = 0; i < NUM_SPHERES; i++){
+	// Post-transform cache order and vertex fetch order for every level
+	optimizeMesh(sphere_buf, sphere_indices, sphere_levels, 3, USE_OVERDRAW_SORT);
 
-        //load texture into var
-        planet_map[i] = loadImage(PLANET_TEXTURE[i].c_str(), x, y, n, false);
-        //check if
-        if(planet_map[i] == NULL){
-            cout << "Image: " << PLANET_TEXTURE[i] << " was not found" << endl;
+	std::cout << "Sphere LODs:";
+	for(size_t i = 0; i < sphere_levels.size(); i++) {
+		std::cout << " " << sphere_levels[i].triangles;
+	}
+	std::cout << " triangles" << std::endl;
+
+	// Narrowest index type (and strips) for every level
+	IndexBuffer sphere_index_buffer;
+	buildIndexBuffer(sphere_indices, sphere_levels, USE_TRIANGLE_STRIPS, sphere_index_buffer);
+	std::cout << "Sphere indexes: " << sphere_index_buffer.size() << " x " << (sphere_index_buffer.type == GL_UNSIGNED_SHORT ? 16 : 32) << " bit"
+	          << (sphere_index_buffer.mode == GL_TRIANGLE_STRIP ? " (strips)" : "") << std::endl;
+
+	// Report cache behaviour of the finest level
+	VertexCacheStats sphere_cache = analyzeVertexCache(sphere_index_buffer, sphere_levels[0]);
+	std::cout << "Sphere vertex cache: ACMR " << sphere_cache.acmr << ", ATVR " << sphere_cache.atvr << std::endl;
+
+    //set up one vbo and ebo shared by every body
+	GLuint sphere_vao = 0;
+	GLuint sphere_vbo = 0;
+	GLuint sphere_ebo = 0;
+
+    glGenVertexArrays(1, &sphere_vao);
+    glGenBuffers(1, &sphere_vbo);
+    glGenBuffers(1, &sphere_ebo);
+
+    glBindVertexArray(sphere_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_ebo);
+
+    // Load Vertex Data - packed vertices are written straight into the mapped
+    // buffer (no packed host copy); unpacked vertices and the indexes below are
+    // uploaded from the host vectors
+    if(USE_PACKED_VERTICES){
+        size_t sphere_vertices = sphere_buf.size() / 3;
+        glBufferData(GL_ARRAY_BUFFER, sphere_vertices * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+        void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, sphere_vertices * sizeof(PackedVertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        bool uploaded = false;
+        if(mapped != NULL){
+            packVertices(sphere_buf.data(), sphere_vertices, (PackedVertex*)mapped);
+            uploaded = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
         }
 
-        glGenTextures(1, &sphere_textures[i]);
+        // Map failed (or the store was lost while mapped) - pack a host copy and upload that
+        if(!uploaded){
+            std::cerr << "Warning: could not map sphere vertex buffer, uploading a host copy" << std::endl;
+            vector<PackedVertex> packed;
+            packVertices(sphere_buf, packed);
+            glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+        }
+    }else{
+        glBufferData(GL_ARRAY_BUFFER, sphere_buf.size() * sizeof(glm::vec4), sphere_buf.data(), GL_STATIC_DRAW);
+    }
 
-        glBindTexture(GL_TEXTURE_2D, sphere_textures[i]);
+    // Load Element Data
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere_index_buffer.bytes(), sphere_index_buffer.data(), GL_STATIC_DRAW);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE, planet_map[i]);
+    // Host copies are no longer needed (levels keep the ranges the draws use)
+    vector<glm::vec4>().swap(sphere_buf);
+    vector<glm::ivec3>().swap(sphere_indices);
+    sphere_index_buffer.release();
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // No mip-mapping
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Attribute locations are fixed in the shaders (layout qualifiers) so the
+    // sun, planet and instanced programs can all share this vertex layout
+    setSphereAttributes();
 
-        // Configure Texture Coordinate Wrapping
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     GL_CLAMP_TO_EDGE);
+    // Unbind VAO, VBO & EBO
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-        glBindTexture(GL_TEXTURE_2D,0);
-        delete[] planet_map[i];
-        planet_map[i] = NULL;
-    }
+    // ----------------------------------------
+    // Set Texture Unit (and how the vertex shaders decode the sphere vertices)
+    sun_program.use();
+    sun_program.setInt(sun_program.getUniformLocation("u_texture_Map"), 0);
+    sun_program.setInt(sun_program.getUniformLocation("u_Packed_Vertices"), USE_PACKED_VERTICES);
+    sphere_program.use();
+    sphere_program.setInt(sphere_program.getUniformLocation("u_texture_Map"), 0);
+    sphere_program.setInt(sphere_program.getUniformLocation("u_Packed_Vertices"), USE_PACKED_VERTICES);
 
 	//------------------------------------------
-	// Create sphere data and vao
+	// Instanced bodies
 	//------------------------------------------
-    glUseProgram(sphere_program);
-	//buffer data
-    vector<glm::vec4> sphere_buf;
-	vector<glm::ivec3> sphere_indices;
+	// Every visible non-sun body is one instance, grouped by mesh level. The
+	// instance buffer holds a region per level - model matrices then layers -
+	// filled from these staging arrays
+	const size_t num_instances = bodies.size() - 1;
+	AlignedArray<float> instance_models(SPHERE_LOD_LEVELS * num_instances * 16);
+	AlignedArray<int> instance_layers(SPHERE_LOD_LEVELS * num_instances);
+	const size_t instance_model_size = num_instances * 16 * sizeof(float);
+	const size_t instance_layer_size = num_instances * sizeof(int);
+	const size_t instance_region_size = instance_model_size + instance_layer_size;
+
+	// Instanced VAO per level - same vbo/ebo as the sphere plus the level's region of the instance buffer
+	GLuint instance_vao[SPHERE_LOD_LEVELS];
+	GLuint instance_vbo = 0;
+
+	glGenVertexArrays(SPHERE_LOD_LEVELS, instance_vao);
+	glGenBuffers(1, &instance_vbo);
+
+	// Instance buffer (rewritten every frame)
+	glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER, SPHERE_LOD_LEVELS * instance_region_size, NULL, GL_STREAM_DRAW);
+
+	for(int l = 0; l < SPHERE_LOD_LEVELS; l++) {
+		size_t region = l * instance_region_size;
+		glBindVertexArray(instance_vao[l]);
+
+		// Shared sphere mesh
+		glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_ebo);
+		setSphereAttributes();
+
+		// Model matrix - one vec4 column per attribute location
+		glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+		for(int c = 0; c < 4; c++) {
+			glVertexAttribPointer(INSTANCE_MODEL_LOC + c, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (GLvoid*)(region + c*4*sizeof(float)));
+			glEnableVertexAttribArray(INSTANCE_MODEL_LOC + c);
+			glVertexAttribDivisor(INSTANCE_MODEL_LOC + c, 1);
+		}
+
+		// Texture layer (integer column - follows the model matrices)
+		glVertexAttribIPointer(INSTANCE_LAYER_LOC, 1, GL_INT, sizeof(int), (GLvoid*)(region + instance_model_size));
+		glEnableVertexAttribArray(INSTANCE_LAYER_LOC);
+		glVertexAttribDivisor(INSTANCE_LAYER_LOC, 1);
+	}
+
+	// Unbind VAO & VBOs
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// Set Texture Unit
+	instanced_program.use();
+	instanced_program.setInt(instanced_program.getUniformLocation("u_texture_Map"), 0);
+	instanced_program.setInt(instanced_program.getUniformLocation("u_Packed_Vertices"), USE_PACKED_VERTICES);
 
-	createSphereData(sphere_buf, sphere_indices, 0.1f, 50, 50);
+	//------------------------------------------
+	// N-body particles
+	//------------------------------------------
+	// Optional asteroid belt integrated by the simulation (Barnes-Hut gravity)
+	NBodySystem particles(SUN_MASS, PARTICLE_SOFTENING, PARTICLE_THETA);
+	particles.addBelt(options.particles, BELT_INNER, BELT_OUTER, BELT_THICKNESS, BELT_MASS, 1);
 
-    //set up the vao, vbo and ebo for spheres
-	GLuint sphere_vao[NUM_SPHERES];
-	GLuint sphere_vbo[NUM_SPHERES];
-	GLuint sphere_ebo[NUM_SPHERES];
+	//------------------------------------------
+	// Impostors
+	//------------------------------------------
+	// Particles and bodies too small on screen for a mesh are camera-facing point
+	// sprites, all drawn with one call. The buffer holds centres (xyz and radius)
+	// then layers - particles first, followed by this frame's body impostors
+	const size_t num_impostors = particles.size() + bodies.size();
+	AlignedArray<float> impostor_centres(num_impostors * 4);
+	AlignedArray<int> impostor_layers(num_impostors);
+	const size_t impostor_centre_size = num_impostors * 4 * sizeof(float);
+	const size_t impostor_layer_size = num_impostors * sizeof(int);
+
+	// Particles have no texture layer
+	for(size_t i = 0; i < particles.size(); i++) {
+		impostor_layers[i] = -1;
+	}
 
-	for(int i = 0; i < NUM_SPHERES; i++){
-        glGenVertexArrays(1, &sphere_vao[i]);
-        glGenBuffers(1, &sphere_vbo[i]);
-        glGenBuffers(1, &sphere_ebo[i]);
+	GLuint impostor_vao = 0;
+	GLuint impostor_vbo = 0;
 
-        glBindVertexArray(sphere_vao[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo[i]);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_ebo[i]);
+	glGenVertexArrays(1, &impostor_vao);
+	glGenBuffers(1, &impostor_vbo);
 
-        // Load Vertex Data
-        glBufferData(GL_ARRAY_BUFFER, sphere_buf.size() * sizeof(glm::vec4), sphere_buf.data(), GL_STATIC_DRAW);
+	glBindVertexArray(impostor_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, impostor_vbo);
+	glBufferData(GL_ARRAY_BUFFER, impostor_centre_size + impostor_layer_size, NULL, GL_STREAM_DRAW);
+	glVertexAttribPointer(IMPOSTOR_CENTRE_LOC, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
+	glEnableVertexAttribArray(IMPOSTOR_CENTRE_LOC);
+	glVertexAttribIPointer(IMPOSTOR_LAYER_LOC, 1, GL_INT, sizeof(int), (GLvoid*)impostor_centre_size);
+	glEnableVertexAttribArray(IMPOSTOR_LAYER_LOC);
 
-        // Load Element Data
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere_indices.size() * sizeof(glm::ivec3), sphere_indices.data(), GL_STATIC_DRAW);
-
-        GLuint sphere_posLoc;
-        GLuint sphere_normLoc;
-        GLuint sphere_texLoc;
-        //set position location
-        if(i == 0){//the sun
-            sphere_posLoc = glGetAttribLocation(sun_program, "vert_Position");
-            sphere_texLoc = glGetAttribLocation(sun_program, "vert_UV");
-            // Set Vertex Attribute Pointers
-            glVertexAttribPointer(sphere_posLoc, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), NULL);
-            glVertexAttribPointer(sphere_texLoc, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), (GLvoid*)(8*sizeof(float)));
-            // Enable Vertex Attribute Arrays
-            glEnableVertexAttribArray(sphere_posLoc);
-            glEnableVertexAttribArray(sphere_texLoc);
-        }else{
-            sphere_posLoc = glGetAttribLocation(sphere_program, "vert_Position");
-            sphere_normLoc = glGetAttribLocation(sphere_program, "vert_Norm");
-            sphere_texLoc = glGetAttribLocation(sphere_program, "vert_UV");
-            // Set Vertex Attribute Pointers
-            glVertexAttribPointer(sphere_posLoc, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), NULL);
-            glVertexAttribPointer(sphere_normLoc, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), (GLvoid*)(4*sizeof(float)));
-            glVertexAttribPointer(sphere_texLoc, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat), (GLvoid*)(8*sizeof(float)));
-            // Enable Vertex Attribute Arrays
-            glEnableVertexAttribArray(sphere_posLoc);
-            glEnableVertexAttribArray(sphere_normLoc);
-            glEnableVertexAttribArray(sphere_texLoc);
-        }
+	// Unbind VAO & VBO
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        // Unbind VAO, VBO & EBO
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-        // ----------------------------------------
-        // Set Texture Unit
-        if(i == 0){
-            glUseProgram(sun_program);
-            glUniform1i(glGetUniformLocation(sun_program, "u_texture_Map"), 0);
-        }else{
-            glUseProgram(sphere_program);
-            glUniform1i(glGetUniformLocation(sphere_program, "u_texture_Map"), 0);
-        }
-	}
+	// Sprites size themselves in the vertex shader
+	glEnable(GL_PROGRAM_POINT_SIZE);
 
+	// Set Texture Unit (the sun's layer is drawn unlit)
+	impostor_program.use();
+	impostor_program.setInt(impostor_program.getUniformLocation("u_texture_Map"), 0);
+	impostor_program.setFloat(impostor_program.getUniformLocation("u_Emissive_Layer"), (float)bodies.layer[0]);
 
 	// ----------------------------------------
 	// Skybox
 	// ----------------------------------------
 
 	// Skybox Program
-	glUseProgram(skybox_program);
+	skybox_program.use();
 
 	// Vertex and Index buffers (host)
 	std::vector<glm::vec4> skybox_buffer;
@@ -352,6 +700,9 @@ int main() {
 	// Create Skybox
 	createSkybox(skybox_buffer, skybox_indexes);
 
+	// Post-transform cache order and vertex fetch order (seen from inside, so no overdraw sort)
+	optimizeMesh(skybox_buffer, skybox_indexes, 1, false);
+
 	// Vertex Array Objects (VAO)
 	GLuint skybox_vao = 0;
 
@@ -375,10 +726,18 @@ int main() {
 	glBufferData(GL_ARRAY_BUFFER, skybox_buffer.size() * sizeof(glm::vec4), skybox_buffer.data(), GL_STATIC_DRAW);
 
 	// Load Element Data
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, skybox_indexes.size() * sizeof(glm::ivec3), skybox_indexes.data(), GL_STATIC_DRAW);
+	IndexBuffer skybox_index_buffer;
+	buildIndexBuffer(skybox_indexes, skybox_index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, skybox_index_buffer.bytes(), skybox_index_buffer.data(), GL_STATIC_DRAW);
+
+	// Release host copies
+	const GLsizei skybox_index_count = skybox_index_buffer.size();
+	std::vector<glm::vec4>().swap(skybox_buffer);
+	std::vector<glm::ivec3>().swap(skybox_indexes);
+	skybox_index_buffer.release();
 
 	// Get Position Attribute location (must match name in shader)
-	GLuint skybox_posLoc = glGetAttribLocation(skybox_program, "vert_Position");
+	GLuint skybox_posLoc = glGetAttribLocation(skybox_program.id(), "vert_Position");
 
 	// Set Vertex Attribute Pointers
 	glVertexAttribPointer(skybox_posLoc, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
@@ -393,15 +752,8 @@ int main() {
 
 	// ----------------------------------------
 	// Set Texture Unit
-	glUseProgram(skybox_program);
-	glUniform1i(glGetUniformLocation(skybox_program, "u_texture_Map"), 0);
-
-	// ----------------------------------------
-	// View Matrix
-	// ----------------------------------------
-	// Copy Skybox View Matrix to Shader
-	glUseProgram(skybox_program);
-	glUniformMatrix4fv(glGetUniformLocation(skybox_program, "u_View"),  1, GL_FALSE, glm::value_ptr(camera->getOrientationMatrix()));
+	skybox_program.use();
+	skybox_program.setInt(skybox_program.getUniformLocation("u_texture_Map"), 0);
 
 	// ----------------------------------------
 	// Projection Matrix
@@ -409,25 +761,67 @@ int main() {
 	glm::mat4 projectionMatrix;
 
 	// Calculate Perspective Projection
-	projectionMatrix = glm::perspective(glm::radians(67.0f), 1.0f, 0.001f, 50.0f);
-
-	// Copy Projection Matrix to Shader
-	glUseProgram(skybox_program);
-	glUniformMatrix4fv(glGetUniformLocation(skybox_program, "u_Projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+	projectionMatrix = glm::perspective(glm::radians(67.0f), (float)options.width / options.height, 0.001f, 50.0f);
+
+	// Level of detail - screen-space error budget and the error of every sphere level
+	LODSettings lod_settings;
+	lod_settings.pixel_error = options.lod_error;
+	lod_settings.min_radius = LOD_MIN_RADIUS;
+	lod_settings.hysteresis = LOD_HYSTERESIS;
+	float pixel_scale = getPixelScale(glm::value_ptr(projectionMatrix), options.height);
+	impostor_program.use();
+	impostor_program.setFloat(impostor_program.getUniformLocation("u_Pixel_Scale"), pixel_scale);
+	float sphere_errors[SPHERE_LOD_LEVELS];
+	for(int l = 0; l < SPHERE_LOD_LEVELS; l++) {
+		sphere_errors[l] = sphere_levels[l].error;
+	}
 
-	glUseProgram(sphere_program);
-	glUniformMatrix4fv(glGetUniformLocation(sphere_program, "u_Projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+	// Sun (light source) sits at the origin
+	glm::vec4 lightPosition = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
-	glUseProgram(sun_program);
-	glUniformMatrix4fv(glGetUniformLocation(sun_program, "u_Projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+	// ----------------------------------------
+	// Render State
+	// ----------------------------------------
+	// All render loop state changes go through the tracker so redundant calls are skipped
+	RenderState render_state;
+	DrawList draw_list;
+	unsigned long frames = 0;
+
+	// Frame capture (asynchronous readback and file writing)
+	FrameCapture *capture = NULL;
+	if (!options.capture.empty()) {
+		capture = new FrameCapture(options.width, options.height, options.capture_format, options.capture);
+	}
 
 	// ----------------------------------------
 	// Main Render loop
 	// ----------------------------------------
-	float time = glfwGetTime();
-	while (!glfwWindowShouldClose(window)) {
+	// Headless frames advance a fixed 1/60 s so runs are repeatable
+	const float HEADLESS_FRAME_TIME = 1.0f / 60.0f;
+
+	double time = options.headless ? 0.0 : glfwGetTime();
+
+	// Simulation runs on its own thread and hands each step over as a snapshot.
+	// Headless runs advance it from this loop instead so they stay repeatable.
+	simulation_clock.setTimeScale(options.time_scale);
+	SimulationThread simulation(simulation_clock, bodies, scene, jobs, particles.size() > 0 ? &particles : NULL);
+	if (!options.headless) {
+		simulation.start();
+	}
+
+	// Interpolated model matrix, visibility and sphere level of every body in the
+	// snapshot being drawn (all start at the finest level)
+	AlignedArray<float> draw_model(bodies.size() * 16);
+	AlignedArray<uint8_t> visible(bodies.size());
+	AlignedArray<int> body_levels(bodies.size());
+	unsigned long long triangles_drawn = 0;
+	unsigned long long impostors_drawn = 0;
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	while (options.headless ? frames < (unsigned long)options.frames : !glfwWindowShouldClose(window)) {
 		// Make the context of the given window current on the calling thread
-		glfwMakeContextCurrent(window);
+		if (window != NULL) {
+			glfwMakeContextCurrent(window);
+		}
 
 		// Set clear (background) colour to black
 		glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
@@ -436,121 +830,237 @@ int main() {
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// Update Time
-		float current_time = glfwGetTime();
+		double current_time = options.headless ? frames * HEADLESS_FRAME_TIME : glfwGetTime();
 		float dt = current_time - time;
 		time = current_time;
 
 		// Update Camera (poll keyboard)
 		camera->update(dt);
 
+		// Advance simulation in fixed steps (on this thread in headless mode)
+		if (!simulation.isRunning()) {
+			simulation.advance(dt);
+		}
 
-		// Copy Skybox View Matrix to Shader
-		glUseProgram(skybox_program);
-        glUniformMatrix4fv(glGetUniformLocation(skybox_program, "u_View"),  1, GL_FALSE, glm::value_ptr(camera->getOrientationMatrix()));
-
-		// ----------------------------------------
-		// Draw Skybox
-		// ----------------------------------------
-
-		// Use Skybox Program
-		glUseProgram(skybox_program);
-
-		// Bind Vertex Array Object
-		glBindVertexArray(skybox_vao);
-
-		// Disable Depth-Testing
-		glDisable(GL_DEPTH_TEST);
-
-		// Set active Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
-
-		// Bind Texture Map
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_texture);
+		// Latest complete simulation step, drawn part way from the step before it
+		const SceneSnapshot &snapshot = simulation.acquire();
+		const float alpha = (float)simulation.getAlpha(snapshot);
 
-		// Draw Elements (Triangles)
-		glDrawElements(GL_TRIANGLES, skybox_indexes.size() * 3, GL_UNSIGNED_INT, NULL);
+		// Model matrices at this moment (composed from the blended centre and spin of every body)
+		const size_t body_count = snapshot.layer.size();
+		interpolateBodies(snapshot, alpha, draw_model.data(), jobs);
 
-		// Renable Depth-Testing
-		glEnable(GL_DEPTH_TEST);
+		// Copy this frame's camera state to the shared uniform block
+		frame_data.view        = camera->getViewMatrix();
+		frame_data.projection  = projectionMatrix;
+		frame_data.orientation = camera->getOrientationMatrix();
+		frame_data.light       = lightPosition;
+		frame_data.time        = snapshot.previous_time + (snapshot.time - snapshot.previous_time) * alpha;
 
-		// Set active Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
+		glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame_data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-		// Unbind Texture Map
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		glBindVertexArray(0);
 		// ----------------------------------------
+		// Draw Skybox
+		// ----------------------------------------
+		draw_list.clear();
+
+		// Skybox is drawn first (pass 0) without depth-testing
+		DrawCommand skybox_draw = makeDrawCommand(0, skybox_program.id(), GL_TEXTURE_CUBE_MAP, cubemap_texture, skybox_vao, skybox_index_count);
+		skybox_draw.type = skybox_index_buffer.type;
+		skybox_draw.depth_test = false;
+		draw_list.submit(skybox_draw);
 
         //---------------------------------------
         //draw spheres
         //---------------------------------------
+        //skip bodies outside the view
+        glm::mat4 view_projection = projectionMatrix * frame_data.view;
+        cullBodies(draw_model.data(), snapshot.radius.data(), visible.data(), body_count, glm::value_ptr(view_projection), jobs);
+
+        //pick a sphere level per body from its size on screen (-1 draws an impostor)
+        const float *view = glm::value_ptr(frame_data.view);
+        float eye[3];
+        for(int k = 0; k < 3; k++){
+            eye[k] = -(view[k * 4 + 0] * view[12] + view[k * 4 + 1] * view[13] + view[k * 4 + 2] * view[14]);
+        }
+        selectBodyLevels(draw_model.data(), snapshot.radius.data(), visible.data(), body_levels.data(), body_count,
+                         eye, pixel_scale, sphere_errors, SPHERE_LOD_LEVELS, lod_settings, jobs);
+
+        size_t visible_instances[SPHERE_LOD_LEVELS] = {0};
+        const size_t particle_count = snapshot.particles.size() / 3;
+        size_t impostor_count = particle_count;
+        for(size_t i = 0; i < body_count; i++){
+            int level = body_levels[i];
+            if(!visible[i]){
+                continue;
+            }
 
-        for(int i = 0; i < NUM_SPHERES; i++){
-            //set up all of the transform matrices
-            float sc[16];
-            float translation[16];
-            float rot_around[16], rot_inplace[16];
-            float temp[16],temp2[16];
-            float model[16];
+            //too small for a mesh - one sprite (centre from the model matrix)
+            if(level < 0){
+                float *centre = &impostor_centres[impostor_count * 4];
+                centre[0] = draw_model[i * 16 + 12];
+                centre[1] = draw_model[i * 16 + 13];
+                centre[2] = draw_model[i * 16 + 14];
+                centre[3] = snapshot.radius[i];
+                impostor_layers[impostor_count] = snapshot.layer[i];
+                impostor_count++;
+                continue;
+            }
+            const MeshLevel &sphere_mesh = sphere_levels[level];
+            triangles_drawn += sphere_mesh.triangles;
+
+            //planets are gathered into the instance buffer (by level) and drawn below
+            if(USE_INSTANCING && i > 0){
+                size_t slot = level * num_instances + visible_instances[level];
+                memcpy(&instance_models[slot * 16], &draw_model[i * 16], 16 * sizeof(float));
+                instance_layers[slot] = snapshot.layer[i];
+                visible_instances[level]++;
+                continue;
+            }
+
+            //every body samples the same texture array (layer selected by u_Layer)
+            DrawCommand body_draw;
+            if(i == 0){
+                body_draw = makeDrawCommand(1, sun_program.id(), GL_TEXTURE_2D_ARRAY, planet_texture_array, sphere_vao, sphere_mesh.indices);
+                body_draw.model_location = sun_modelLoc;
+                body_draw.layer_location = sun_layerLoc;
+            }else{
+                body_draw = makeDrawCommand(1, sphere_program.id(), GL_TEXTURE_2D_ARRAY, planet_texture_array, sphere_vao, sphere_mesh.indices);
+                body_draw.model_location = sphere_modelLoc;
+                body_draw.layer_location = sphere_layerLoc;
+            }
+            body_draw.mode = sphere_index_buffer.mode;
+            body_draw.primitive_restart = sphere_index_buffer.mode == GL_TRIANGLE_STRIP;
+            body_draw.first = sphere_mesh.first_index;
+            body_draw.type = sphere_index_buffer.type;
+            memcpy(body_draw.model, &draw_model[i * 16], sizeof(body_draw.model));
+            body_draw.layer = (float)snapshot.layer[i];
+            draw_list.submit(body_draw);
+        }
 
-            //get scale matrix
-            scale(PLANET_SIZES[i], PLANET_SIZES[i], PLANET_SIZES[i], sc);
-            //get translate matrix
-            translate((0.8f * (0.4 * i)), 0.0f, 0.0f, translation);
+        //---------------------------------------
+        //draw planets (one instanced draw per level)
+        //---------------------------------------
+        if(USE_INSTANCING){
+            //upload this frame's instance data (orphan the old store first)
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            glBufferData(GL_ARRAY_BUFFER, SPHERE_LOD_LEVELS * instance_region_size, NULL, GL_STREAM_DRAW);
+            for(int l = 0; l < SPHERE_LOD_LEVELS; l++){
+                if(visible_instances[l] == 0){
+                    continue;
+                }
+                size_t region = l * instance_region_size;
+                glBufferSubData(GL_ARRAY_BUFFER, region, visible_instances[l] * 16 * sizeof(float), &instance_models[l * num_instances * 16]);
+                glBufferSubData(GL_ARRAY_BUFFER, region + instance_model_size, visible_instances[l] * sizeof(int), &instance_layers[l * num_instances]);
+
+                DrawCommand instanced_draw = makeDrawCommand(1, instanced_program.id(), GL_TEXTURE_2D_ARRAY, planet_texture_array, instance_vao[l], sphere_levels[l].indices);
+                instanced_draw.mode = sphere_index_buffer.mode;
+                instanced_draw.primitive_restart = sphere_index_buffer.mode == GL_TRIANGLE_STRIP;
+                instanced_draw.first = sphere_levels[l].first_index;
+                instanced_draw.type = sphere_index_buffer.type;
+                instanced_draw.instances = visible_instances[l];
+                draw_list.submit(instanced_draw);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
 
-            //get rotation around sun matrix
-            rotateY(glfwGetTime() * PLANET_SPEED[i] + PLANET_START_LOC[i], rot_around);
-            //rotateY(0, rot_around); // keep planets in a line
+        //---------------------------------------
+        //draw impostors (particles and small bodies, one point each)
+        //---------------------------------------
+        if(impostor_count > 0){
+            //particle centres between the last two snapshots' positions
+            const float *from = snapshot.previous_particles.data();
+            const float *to = snapshot.particles.data();
+            float *centres = impostor_centres.data();
+            jobs.parallelFor(particle_count, IMPOSTOR_GRAIN, [&](size_t begin, size_t end){
+                for(size_t i = begin; i < end; i++){
+                    for(int k = 0; k < 3; k++){
+                        centres[i * 4 + k] = from[i * 3 + k] + (to[i * 3 + k] - from[i * 3 + k]) * alpha;
+                    }
+                    centres[i * 4 + 3] = PARTICLE_RADIUS;
+                }
+            });
+
+            //upload (orphan the old store first)
+            glBindBuffer(GL_ARRAY_BUFFER, impostor_vbo);
+            glBufferData(GL_ARRAY_BUFFER, impostor_centre_size + impostor_layer_size, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, impostor_count * 4 * sizeof(float), impostor_centres.data());
+            glBufferSubData(GL_ARRAY_BUFFER, impostor_centre_size, impostor_count * sizeof(int), impostor_layers.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            DrawCommand impostor_draw = makeDrawCommand(1, impostor_program.id(), GL_TEXTURE_2D_ARRAY, planet_texture_array, impostor_vao, impostor_count);
+            impostor_draw.mode = GL_POINTS;
+            impostor_draw.type = 0;
+            draw_list.submit(impostor_draw);
+            impostors_drawn += impostor_count;
+        }
 
-            //get rotation around the y axis
-            rotateY(glfwGetTime() * 0.5, rot_inplace);
+        //issue every draw sorted by program -> texture -> VAO
+        draw_list.sort();
+        draw_list.execute(render_state);
 
-            //rotate and then translate
-            multiply44(translation, rot_inplace, temp);
-            //rotate around sun
-            multiply44(rot_around, temp, temp2);
-            //scale size
-            multiply44(temp2, sc, model);
+		// Queue readback of this frame
+		if (capture != NULL) {
+			capture->capture(frames);
+		}
 
-            GLint modelLoc;
+		frames++;
 
-            if(i == 0){
-                glUseProgram(sun_program);
-                glUniformMatrix4fv(glGetUniformLocation(sun_program, "u_View"),  1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
-                modelLoc = glGetUniformLocation(sun_program, "u_Model");
-            }else{
-                glUseProgram(sphere_program);
-                glUniformMatrix4fv(glGetUniformLocation(sphere_program, "u_View"),  1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
-                modelLoc = glGetUniformLocation(sphere_program, "u_Model");
-            }
+		if (window != NULL) {
+			// Swap the back and front buffers
+			glfwSwapBuffers(window);
 
+			// Poll window events
+			glfwPollEvents();
+		}
+	}
 
+	// Stop the simulation
+	simulation.stop();
 
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, model);
+	// Report frame times (wait for the last frame and captured files first)
+	if (capture != NULL) {
+		capture->finish();
+	}
+	glFinish();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	if(frames > 0) {
+		std::cout << "Rendered " << frames << " frames (" << options.width << "x" << options.height << ") in " << elapsed << " s, "
+		          << 1000.0 * elapsed / frames << " ms/frame" << std::endl;
+	}
 
-            //enable depth testing for spheres
-            glEnable(GL_DEPTH_TEST);
-            //bind vertex array
-            glBindVertexArray(sphere_vao[i]);
-            //set active texture and bind correct texture
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, sphere_textures[i]);
-            //draw the sphere with texture
-            glDrawElements(GL_TRIANGLES, sphere_indices.size() * 3, GL_UNSIGNED_INT, NULL);
-            //unbind the texture
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glActiveTexture(GL_TEXTURE0);
-            //unbind vertex array object
-            glBindVertexArray(0);
-        }
+	// Report simulation steps handed to the renderer
+	std::cout << "Simulation: " << simulation.getPublished() << " snapshots published" << std::endl;
 
+	// Report sphere triangles drawn (level of detail)
+	if(frames > 0) {
+		std::cout << "Sphere triangles: " << triangles_drawn / frames << " per frame" << std::endl;
+		std::cout << "Impostors: " << impostors_drawn / frames << " per frame" << std::endl;
+	}
 
+	// Report N-body cost (and simulation time the particles skipped to keep the steps fixed)
+	if(particles.getSteps() > 0) {
+		std::cout << "N-body: " << particles.size() << " particles, " << particles.getNodeCount() << " tree nodes, "
+		          << 1000.0 * particles.getStepSeconds() / particles.getSteps() << " ms/step, "
+		          << simulation.getDroppedParticleTime() << " s dropped" << std::endl;
+	}
 
-		// Swap the back and front buffers
-		glfwSwapBuffers(window);
+	// Stop frame capture
+	if (capture != NULL) {
+		std::cout << "Captured " << capture->getWritten() << " frames to " << options.capture << "*" << std::endl;
+		if (capture->getFailed() > 0) {
+			std::cerr << "Error: " << capture->getFailed() << " frames could not be captured" << std::endl;
+		}
+		delete capture;
+	}
 
-		// Poll window events
-		glfwPollEvents();
+	// Report state changes issued and skipped by the state tracker
+	if(frames > 0) {
+		const RenderState::Stats &stats = render_state.getStats();
+		std::cout << "Render state: " << stats.issued << " calls issued, " << stats.elided << " elided ("
+		          << (float)stats.elided / frames << " elided per frame)" << std::endl;
 	}
 
 	// Delete VAO, VBO & EBO
@@ -558,23 +1068,45 @@ int main() {
 	glDeleteBuffers(1, &skybox_vbo);
 	glDeleteBuffers(1, &skybox_ebo);
 
-	for(int i = 0; i < NUM_SPHERES; i++){
-        glDeleteVertexArrays(1, &sphere_vao[i]);
-        glDeleteBuffers(1, &sphere_vbo[i]);
-        glDeleteBuffers(1, &sphere_ebo[i]);
-	}
+	glDeleteVertexArrays(1, &sphere_vao);
+	glDeleteVertexArrays(SPHERE_LOD_LEVELS, instance_vao);
+	glDeleteVertexArrays(1, &impostor_vao);
+	glDeleteBuffers(1, &impostor_vbo);
+	glDeleteBuffers(1, &sphere_vbo);
+	glDeleteBuffers(1, &sphere_ebo);
+	glDeleteBuffers(1, &instance_vbo);
+	glDeleteBuffers(1, &frame_ubo);
 
-	// Delete Program
-	glDeleteProgram(skybox_program);
-	glDeleteProgram(sphere_program);
-	glDeleteProgram(sun_program);
+	// Delete Textures
+	glDeleteTextures(1, &cubemap_texture);
+	glDeleteTextures(1, &planet_texture_array);
 
-	// Stop receiving events for the window and free resources; this must be
-	// called from the main thread and should not be invoked from a callback
-	glfwDestroyWindow(window);
+	// Delete Program
+	skybox_program.destroy();
+	sphere_program.destroy();
+	sun_program.destroy();
+	instanced_program.destroy();
+	impostor_program.destroy();
+
+	if (options.headless) {
+		// Delete offscreen render target
+		glDeleteFramebuffers(1, &headless_fbo);
+		glDeleteRenderbuffers(1, &headless_colour);
+		glDeleteRenderbuffers(1, &headless_depth);
+
+		// Release EGL context
+		destroyHeadlessContext(headless);
+	} else {
+		// Stop receiving events for the window and free resources; this must be
+		// called from the main thread and should not be invoked from a callback
+		glfwDestroyWindow(window);
+
+		// Terminate GLFW
+		glfwTerminate();
+	}
 
-	// Terminate GLFW
-	glfwTerminate();
+	// Delete Camera
+	delete camera;
 
 	return 0;
 }
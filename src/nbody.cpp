@@ -0,0 +1,752 @@
+// System Headers
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+// Project Headers
+#include "nbody.h"
+#include "transforms.h"
+#include "simd.h"
+
+// --------------------------------------------------------------------------------
+// Morton Codes
+// --------------------------------------------------------------------------------
+// Spread the low 21 bits of v so there are two zero bits between each
+static inline uint64_t expandBits(uint64_t v) {
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x001f00000000ffffULL;
+	v = (v | v << 16) & 0x001f0000ff0000ffULL;
+	v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+	v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+	v = (v | v << 2)  & 0x1249249249249249ULL;
+	return v;
+}
+
+// Octant of a code at a tree level (0 is the root's children)
+static inline int octant(uint64_t code, int level) {
+	return (int)(code >> (3 * (NBodySystem::MORTON_LEVELS - 1 - level))) & 7;
+}
+
+// Radix sort digits
+const int RADIX_BITS = 11;
+const int RADIX_PASSES = 6;
+const int RADIX_SIZE = 1 << RADIX_BITS;
+
+// Digits handed to a job at a time when combining chunk histograms
+const size_t RADIX_GRAIN = 256;
+
+// --------------------------------------------------------------------------------
+// Interaction Lists
+// --------------------------------------------------------------------------------
+// Point masses acting on a group of particles (padded with zero masses to a
+// multiple of LIST_PADDING so the SIMD kernels need no remainder loop)
+struct InteractionList {
+	AlignedArray<float> x, y, z, mass;
+	size_t count;
+
+	InteractionList() : count(0) {}
+
+	void clear() { count = 0; }
+
+	// Append (columns only grow, so a reused list stops allocating)
+	void push(float px, float py, float pz, float pmass) {
+		if(count == mass.size()) {
+			size_t capacity = count < 256 ? 256 : count * 2;
+			x.resize(capacity);
+			y.resize(capacity);
+			z.resize(capacity);
+			mass.resize(capacity);
+		}
+		x[count] = px;
+		y[count] = py;
+		z[count] = pz;
+		mass[count] = pmass;
+		count++;
+	}
+};
+
+const size_t LIST_PADDING = 8;
+
+// Scalar kernel - softened acceleration at p from every entry of the list
+static void sumInteractionsScalar(const InteractionList &list, const float p[3], float eps2, float a[3]) {
+	float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+	for(size_t j = 0; j < list.count; j++) {
+		float dx = list.x[j] - p[0];
+		float dy = list.y[j] - p[1];
+		float dz = list.z[j] - p[2];
+		float inv = 1.0f / sqrtf(dx*dx + dy*dy + dz*dz + eps2);
+		float s = list.mass[j] * inv * inv * inv;
+		fx += dx * s;
+		fy += dy * s;
+		fz += dz * s;
+	}
+	a[0] = fx;
+	a[1] = fy;
+	a[2] = fz;
+}
+
+#if defined(SIMD_X86)
+// Sum of the lanes of a vector
+static inline float horizontalSum4(__m128 v) {
+	__m128 h = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+	return _mm_cvtss_f32(h);
+}
+
+// SSE2 kernel - 4 entries per iteration
+static void sumInteractionsSSE2(const InteractionList &list, const float p[3], float eps2, float a[3]) {
+	const __m128 px = _mm_set1_ps(p[0]), py = _mm_set1_ps(p[1]), pz = _mm_set1_ps(p[2]);
+	const __m128 e2 = _mm_set1_ps(eps2);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 three = _mm_set1_ps(3.0f);
+	__m128 fx = _mm_setzero_ps(), fy = _mm_setzero_ps(), fz = _mm_setzero_ps();
+
+	for(size_t j = 0; j < list.count; j += 4) {
+		__m128 dx = _mm_sub_ps(_mm_load_ps(&list.x[j]), px);
+		__m128 dy = _mm_sub_ps(_mm_load_ps(&list.y[j]), py);
+		__m128 dz = _mm_sub_ps(_mm_load_ps(&list.z[j]), pz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), e2));
+
+		// Reciprocal square root estimate plus one Newton step (about 23 bits)
+		__m128 inv = _mm_rsqrt_ps(d2);
+		inv = _mm_mul_ps(_mm_mul_ps(half, inv), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(d2, inv), inv)));
+		__m128 s = _mm_mul_ps(_mm_load_ps(&list.mass[j]), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+		fx = _mm_add_ps(fx, _mm_mul_ps(dx, s));
+		fy = _mm_add_ps(fy, _mm_mul_ps(dy, s));
+		fz = _mm_add_ps(fz, _mm_mul_ps(dz, s));
+	}
+
+	a[0] = horizontalSum4(fx);
+	a[1] = horizontalSum4(fy);
+	a[2] = horizontalSum4(fz);
+}
+
+// AVX2 kernel - 8 entries per iteration
+__attribute__((target("avx2,fma")))
+static void sumInteractionsAVX2(const InteractionList &list, const float p[3], float eps2, float a[3]) {
+	const __m256 px = _mm256_set1_ps(p[0]), py = _mm256_set1_ps(p[1]), pz = _mm256_set1_ps(p[2]);
+	const __m256 e2 = _mm256_set1_ps(eps2);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 three = _mm256_set1_ps(3.0f);
+	__m256 fx = _mm256_setzero_ps(), fy = _mm256_setzero_ps(), fz = _mm256_setzero_ps();
+
+	for(size_t j = 0; j < list.count; j += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_load_ps(&list.x[j]), px);
+		__m256 dy = _mm256_sub_ps(_mm256_load_ps(&list.y[j]), py);
+		__m256 dz = _mm256_sub_ps(_mm256_load_ps(&list.z[j]), pz);
+		__m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, e2)));
+
+		// Reciprocal square root estimate plus one Newton step (about 23 bits)
+		__m256 inv = _mm256_rsqrt_ps(d2);
+		inv = _mm256_mul_ps(_mm256_mul_ps(half, inv), _mm256_fnmadd_ps(_mm256_mul_ps(d2, inv), inv, three));
+		__m256 s = _mm256_mul_ps(_mm256_load_ps(&list.mass[j]), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+		fx = _mm256_fmadd_ps(dx, s, fx);
+		fy = _mm256_fmadd_ps(dy, s, fy);
+		fz = _mm256_fmadd_ps(dz, s, fz);
+	}
+
+	a[0] = horizontalSum4(_mm_add_ps(_mm256_castps256_ps128(fx), _mm256_extractf128_ps(fx, 1)));
+	a[1] = horizontalSum4(_mm_add_ps(_mm256_castps256_ps128(fy), _mm256_extractf128_ps(fy, 1)));
+	a[2] = horizontalSum4(_mm_add_ps(_mm256_castps256_ps128(fz), _mm256_extractf128_ps(fz, 1)));
+}
+#endif // SIMD_X86
+
+// Sum a list with the selected kernel
+static void sumInteractions(TransformKernel kernel, const InteractionList &list, const float p[3], float eps2, float a[3]) {
+	switch(kernel) {
+#if defined(SIMD_X86)
+		case TRANSFORM_AVX2:
+			sumInteractionsAVX2(list, p, eps2, a);
+			break;
+		case TRANSFORM_SSE2:
+			sumInteractionsSSE2(list, p, eps2, a);
+			break;
+#endif
+		default:
+			sumInteractionsScalar(list, p, eps2, a);
+			break;
+	}
+}
+
+// --------------------------------------------------------------------------------
+// N-Body System
+// --------------------------------------------------------------------------------
+// Constructor
+NBodySystem::NBodySystem(float central_mass, float softening, float theta) {
+	mCentralMass = central_mass;
+	mSoftening = softening;
+	mTheta = theta;
+	mAccelerationsValid = false;
+	mSteps = 0;
+	mStepSeconds = 0.0;
+	mInteractions = 0.0;
+}
+
+// Reserve space for count particles
+void NBodySystem::reserve(size_t count) {
+	AlignedArray<float> *columns[] = {&x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az, &mass};
+	for(AlignedArray<float> *column : columns) {
+		column->reserve(count);
+	}
+	id.reserve(count);
+}
+
+// Add a particle
+size_t NBodySystem::add(float px, float py, float pz, float pvx, float pvy, float pvz, float pmass) {
+	x.push_back(px);
+	y.push_back(py);
+	z.push_back(pz);
+	vx.push_back(pvx);
+	vy.push_back(pvy);
+	vz.push_back(pvz);
+	ax.push_back(0.0f);
+	ay.push_back(0.0f);
+	az.push_back(0.0f);
+	mass.push_back(pmass);
+	id.push_back((uint32_t)(size() - 1));
+
+	mAccelerationsValid = false;
+	return size() - 1;
+}
+
+// Add a belt of particles on circular orbits
+void NBodySystem::addBelt(size_t count, float inner, float outer, float thickness, float total_mass, unsigned int seed) {
+	// Fixed seed so runs are repeatable
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	reserve(size() + count);
+	for(size_t i = 0; i < count; i++) {
+		// Uniform over the annulus area
+		float r = sqrtf(inner * inner + (outer * outer - inner * inner) * unit(random));
+		float angle = 6.2831853f * unit(random);
+		float height = thickness * (unit(random) - 0.5f);
+
+		// Circular speed around the (softened) central mass - the belt's own mass is ignored
+		float d2 = r * r + mSoftening * mSoftening;
+		float speed = sqrtf(mCentralMass * r * r / (d2 * sqrtf(d2)));
+
+		// Counter-clockwise seen from +Y, like the planets
+		float c = cosf(angle), s = sinf(angle);
+		add(r * c, height, -r * s, -speed * s, 0.0f, -speed * c, total_mass / count);
+	}
+}
+
+// Remove all particles
+void NBodySystem::clear() {
+	AlignedArray<float> *columns[] = {&x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az, &mass};
+	for(AlignedArray<float> *column : columns) {
+		column->clear();
+	}
+	id.clear();
+	mNodes.clear();
+	mGroups.clear();
+	mAccelerationsValid = false;
+}
+
+// Advance by one leapfrog step
+void NBodySystem::step(float dt, JobSystem &jobs) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Accelerations at the start of the first step
+	if(!mAccelerationsValid) {
+		computeAccelerations(jobs);
+	}
+
+	// Kick half a step and drift a whole step
+	float half = 0.5f * dt;
+	jobs.parallelFor(size(), PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			vx[i] += ax[i] * half;
+			vy[i] += ay[i] * half;
+			vz[i] += az[i] * half;
+			x[i] += vx[i] * dt;
+			y[i] += vy[i] * dt;
+			z[i] += vz[i] * dt;
+		}
+	});
+
+	// Accelerations at the new positions, then kick the other half
+	computeAccelerations(jobs);
+	jobs.parallelFor(size(), PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			vx[i] += ax[i] * half;
+			vy[i] += ay[i] * half;
+			vz[i] += az[i] * half;
+		}
+	});
+
+	mSteps++;
+	mStepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compute accelerations for the current positions
+void NBodySystem::computeAccelerations(JobSystem &jobs) {
+	size_t count = size();
+	mNodes.clear();
+	mGroups.clear();
+	if(count == 0) {
+		return;
+	}
+
+	// Sort so every octree cell is a contiguous range of particles
+	sortParticles(jobs);
+
+	// Build the tree
+	buildTree(jobs);
+
+	const Node *nodes = mNodes.data();
+	const int node_count = (int)mNodes.size();
+	const float eps2 = mSoftening * mSoftening;
+	const float central = mCentralMass;
+	const TransformKernel kernel = getTransformKernel();
+	std::atomic<unsigned long long> interactions(0);
+
+	jobs.parallelFor(mGroups.size(), GROUP_GRAIN, [&](size_t begin, size_t end) {
+		InteractionList list;
+		unsigned long long job_interactions = 0;
+
+		for(size_t g = begin; g < end; g++) {
+			const Group &group = mGroups[g];
+
+			// Walk the tree once for the group - a cell is accepted when it is far
+			// enough from the nearest point of the group's box
+			list.clear();
+			int n = 0;
+			while(n < node_count) {
+				const Node &node = nodes[n];
+				float dx = std::max(std::max(group.bounds[0] - node.x, node.x - group.bounds[3]), 0.0f);
+				float dy = std::max(std::max(group.bounds[1] - node.y, node.y - group.bounds[4]), 0.0f);
+				float dz = std::max(std::max(group.bounds[2] - node.z, node.z - group.bounds[5]), 0.0f);
+
+				if(dx*dx + dy*dy + dz*dz > node.open2) {
+					// Far enough - the whole cell acts as a point mass
+					list.push(node.x, node.y, node.z, node.mass);
+					n = node.next;
+				} else if(node.next == n + 1) {
+					// Leaf - its particles act directly (a particle on itself adds nothing)
+					for(int j = node.begin; j < node.begin + node.count; j++) {
+						list.push(x[j], y[j], z[j], mass[j]);
+					}
+					n = node.next;
+				} else {
+					// Open the cell - its first child follows it
+					n++;
+				}
+			}
+
+			// Pad with massless entries
+			while(list.count % LIST_PADDING != 0) {
+				list.push(0.0f, 0.0f, 0.0f, 0.0f);
+			}
+
+			// Sum the list for every particle in the group
+			const Node &group_node = nodes[group.node];
+			for(int i = group_node.begin; i < group_node.begin + group_node.count; i++) {
+				float p[3] = {x[i], y[i], z[i]};
+				float a[3];
+				sumInteractions(kernel, list, p, eps2, a);
+
+				// Central mass at the origin
+				float inv = 1.0f / sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2] + eps2);
+				float s = central * inv * inv * inv;
+				ax[i] = a[0] - p[0] * s;
+				ay[i] = a[1] - p[1] * s;
+				az[i] = a[2] - p[2] * s;
+			}
+			job_interactions += (unsigned long long)list.count * group_node.count;
+		}
+
+		interactions += job_interactions;
+	});
+
+	mInteractions = (double)interactions;
+	mAccelerationsValid = true;
+}
+
+// Sort particles by Morton code
+void NBodySystem::sortParticles(JobSystem &jobs) {
+	size_t count = size();
+	size_t chunks = (count + PARTICLE_GRAIN - 1) / PARTICLE_GRAIN;
+
+	// Bounding box - per chunk, then combined
+	AlignedArray<float> chunk_bounds(chunks * 6);
+	jobs.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+		for(size_t c = begin; c < end; c++) {
+			float *b = &chunk_bounds[c * 6];
+			b[0] = b[3] = x[c * PARTICLE_GRAIN];
+			b[1] = b[4] = y[c * PARTICLE_GRAIN];
+			b[2] = b[5] = z[c * PARTICLE_GRAIN];
+			for(size_t i = c * PARTICLE_GRAIN; i < std::min(count, (c + 1) * PARTICLE_GRAIN); i++) {
+				b[0] = std::min(b[0], x[i]);  b[3] = std::max(b[3], x[i]);
+				b[1] = std::min(b[1], y[i]);  b[4] = std::max(b[4], y[i]);
+				b[2] = std::min(b[2], z[i]);  b[5] = std::max(b[5], z[i]);
+			}
+		}
+	});
+	float lo[3] = {chunk_bounds[0], chunk_bounds[1], chunk_bounds[2]};
+	float extent = 0.0f;
+	for(size_t c = 0; c < chunks; c++) {
+		for(int a = 0; a < 3; a++) {
+			lo[a] = std::min(lo[a], chunk_bounds[c * 6 + a]);
+		}
+	}
+	for(size_t c = 0; c < chunks; c++) {
+		for(int a = 0; a < 3; a++) {
+			extent = std::max(extent, chunk_bounds[c * 6 + 3 + a] - lo[a]);
+		}
+	}
+
+	// Quantise to the finest cells of a cube around the particles
+	const float cells = (float)(1 << MORTON_LEVELS);
+	float scale = extent > 0.0f ? (cells - 1.0f) / extent : 0.0f;
+
+	mCodes.resize(count);
+	mCodesTemp.resize(count);
+	mOrder.resize(count);
+	mOrderTemp.resize(count);
+	jobs.parallelFor(count, PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			uint64_t qx = (uint64_t)((x[i] - lo[0]) * scale);
+			uint64_t qy = (uint64_t)((y[i] - lo[1]) * scale);
+			uint64_t qz = (uint64_t)((z[i] - lo[2]) * scale);
+			mCodes[i] = expandBits(qx) << 2 | expandBits(qy) << 1 | expandBits(qz);
+			mOrder[i] = (uint32_t)i;
+		}
+	});
+
+	// LSD radix sort of (code, index). Every pass counts the digits of each chunk
+	// of particles, offsets every chunk's buckets past the same digit in earlier
+	// chunks (so the sort stays stable) and scatters the chunks in parallel
+	mHistograms.resize(chunks * RADIX_SIZE);
+	size_t *histograms = mHistograms.data();
+	size_t digit_counts[RADIX_SIZE];
+	for(int pass = 0; pass < RADIX_PASSES; pass++) {
+		int shift = pass * RADIX_BITS;
+		const uint64_t *codes = mCodes.data();
+		const uint32_t *order = mOrder.data();
+		uint64_t *codes_to = mCodesTemp.data();
+		uint32_t *order_to = mOrderTemp.data();
+
+		// Count per chunk
+		jobs.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+			for(size_t c = begin; c < end; c++) {
+				size_t *bucket = &histograms[c * RADIX_SIZE];
+				memset(bucket, 0, RADIX_SIZE * sizeof(size_t));
+				for(size_t i = c * PARTICLE_GRAIN; i < std::min(count, (c + 1) * PARTICLE_GRAIN); i++) {
+					bucket[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+				}
+			}
+		});
+
+		// Totals per digit
+		jobs.parallelFor(RADIX_SIZE, RADIX_GRAIN, [&](size_t begin, size_t end) {
+			for(size_t d = begin; d < end; d++) {
+				size_t n = 0;
+				for(size_t c = 0; c < chunks; c++) {
+					n += histograms[c * RADIX_SIZE + d];
+				}
+				digit_counts[d] = n;
+			}
+		});
+
+		// Skip digits every particle shares
+		if(digit_counts[(codes[0] >> shift) & (RADIX_SIZE - 1)] == count) {
+			continue;
+		}
+
+		// Start of every digit, then of every chunk's share of it
+		size_t offset = 0;
+		for(int d = 0; d < RADIX_SIZE; d++) {
+			size_t n = digit_counts[d];
+			digit_counts[d] = offset;
+			offset += n;
+		}
+		jobs.parallelFor(RADIX_SIZE, RADIX_GRAIN, [&](size_t begin, size_t end) {
+			for(size_t d = begin; d < end; d++) {
+				size_t start = digit_counts[d];
+				for(size_t c = 0; c < chunks; c++) {
+					size_t n = histograms[c * RADIX_SIZE + d];
+					histograms[c * RADIX_SIZE + d] = start;
+					start += n;
+				}
+			}
+		});
+
+		// Scatter
+		jobs.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+			for(size_t c = begin; c < end; c++) {
+				size_t *bucket = &histograms[c * RADIX_SIZE];
+				for(size_t i = c * PARTICLE_GRAIN; i < std::min(count, (c + 1) * PARTICLE_GRAIN); i++) {
+					size_t to = bucket[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+					codes_to[to] = codes[i];
+					order_to[to] = order[i];
+				}
+			}
+		});
+		mCodes.swap(mCodesTemp);
+		mOrder.swap(mOrderTemp);
+	}
+
+	// Reorder the particles (accelerations are about to be recomputed)
+	mTemp.resize(count);
+	AlignedArray<float> *columns[] = {&x, &y, &z, &vx, &vy, &vz, &mass};
+	for(AlignedArray<float> *column : columns) {
+		const float *from = column->data();
+		jobs.parallelFor(count, PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+			for(size_t i = begin; i < end; i++) {
+				mTemp[i] = from[mOrder[i]];
+			}
+		});
+		column->swap(mTemp);
+	}
+
+	// Ids follow their particles (the sort's temporary order is free again)
+	jobs.parallelFor(count, PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			mOrderTemp[i] = id[mOrder[i]];
+		}
+	});
+	id.swap(mOrderTemp);
+}
+
+// Build the tree over the sorted particles
+void NBodySystem::buildTree(JobSystem &jobs) {
+	// Top cells, and a subtree for every cell below them (or too small to split)
+	mTopCells.clear();
+	planTopCell(0, size(), 0, -1);
+	size_t subtrees = 0;
+	for(size_t i = 0; i < mTopCells.size(); i++) {
+		if(mTopCells[i].subtree >= 0) {
+			mTopCells[i].subtree = (int)subtrees++;
+		}
+	}
+	if(mSubtrees.size() < subtrees) {
+		mSubtrees.resize(subtrees);
+	}
+
+	// Build the subtrees in parallel (each into its own arrays)
+	const TopCell *cells = mTopCells.data();
+	const size_t cell_count = mTopCells.size();
+	jobs.parallelFor(cell_count, 1, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const TopCell &cell = cells[i];
+			if(cell.subtree < 0) {
+				continue;
+			}
+			Subtree &subtree = mSubtrees[cell.subtree];
+			subtree.nodes.clear();
+			subtree.groups.clear();
+			buildNode(subtree.nodes, subtree.groups, cell.begin, cell.end, cell.level, false, subtree.bounds);
+		}
+	});
+
+	// Place every top cell and subtree in depth-first order
+	size_t node_count = 0, group_count = 0;
+	AlignedArray<size_t> group_offsets(subtrees);
+	for(size_t i = 0; i < cell_count; i++) {
+		TopCell &cell = mTopCells[i];
+		cell.node = (int)node_count;
+		if(cell.subtree < 0) {
+			node_count++;
+		} else {
+			node_count += mSubtrees[cell.subtree].nodes.size();
+			group_offsets[cell.subtree] = group_count;
+			group_count += mSubtrees[cell.subtree].groups.size();
+		}
+	}
+	mNodes.resize(node_count);
+	mGroups.resize(group_count);
+
+	// Copy the subtrees in, moving their node indexes to where they start
+	jobs.parallelFor(cell_count, 1, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const TopCell &cell = cells[i];
+			if(cell.subtree < 0) {
+				continue;
+			}
+			const Subtree &subtree = mSubtrees[cell.subtree];
+			Node *nodes = &mNodes[cell.node];
+			for(size_t n = 0; n < subtree.nodes.size(); n++) {
+				nodes[n] = subtree.nodes[n];
+				nodes[n].next += cell.node;
+			}
+			Group *groups = &mGroups[group_offsets[cell.subtree]];
+			for(size_t g = 0; g < subtree.groups.size(); g++) {
+				groups[g] = subtree.groups[g];
+				groups[g].node += cell.node;
+			}
+		}
+	});
+
+	// Top cells from their children
+	float bounds[6];
+	finishTopCell(0, bounds);
+}
+
+// List the top cells for sorted particles [begin, end)
+void NBodySystem::planTopCell(size_t begin, size_t end, int level, int parent) {
+	int index = (int)mTopCells.size();
+	TopCell cell;
+	cell.begin = begin;
+	cell.end = end;
+	cell.level = level;
+	cell.parent = parent;
+	cell.node = 0;
+
+	// Cells at the bottom of the top levels, and any that would be a group or a
+	// leaf (both are built whole), are subtrees
+	// (numbered by buildTree)
+	bool split = level < TOP_LEVELS && end - begin > (size_t)GROUP_SIZE;
+	cell.subtree = split ? -1 : 0;
+	mTopCells.push_back(cell);
+	if(!split) {
+		return;
+	}
+
+	// Children - one per occupied octant, as in buildNode
+	size_t child_begin = begin;
+	while(child_begin < end) {
+		int digit = octant(mCodes[child_begin], level);
+		size_t child_end = std::partition_point(&mCodes[child_begin], &mCodes[0] + end, [&](uint64_t code) {
+			return octant(code, level) == digit;
+		}) - &mCodes[0];
+		planTopCell(child_begin, child_end, level + 1, index);
+		child_begin = child_end;
+	}
+}
+
+// Fill in a top cell built from its children
+int NBodySystem::finishTopCell(int cell, float bounds[6]) {
+	const TopCell &top = mTopCells[cell];
+	if(top.subtree >= 0) {
+		memcpy(bounds, mSubtrees[top.subtree].bounds, 6 * sizeof(float));
+		return cell + 1;
+	}
+
+	// Children follow in order, each with its own subtree of top cells
+	float cx = 0.0f, cy = 0.0f, cz = 0.0f, m = 0.0f;
+	bool first = true;
+	int next = cell + 1;
+	while(next < (int)mTopCells.size() && mTopCells[next].parent == cell) {
+		float child_bounds[6];
+		int child = next;
+		next = finishTopCell(child, child_bounds);
+
+		const Node &node = mNodes[mTopCells[child].node];
+		cx += node.x * node.mass;
+		cy += node.y * node.mass;
+		cz += node.z * node.mass;
+		m += node.mass;
+		for(int a = 0; a < 3; a++) {
+			bounds[a]     = first ? child_bounds[a]     : std::min(bounds[a], child_bounds[a]);
+			bounds[a + 3] = first ? child_bounds[a + 3] : std::max(bounds[a + 3], child_bounds[a + 3]);
+		}
+		first = false;
+	}
+
+	Node &node = mNodes[top.node];
+	setNodeMass(node, cx, cy, cz, m, bounds);
+	node.next = next < (int)mTopCells.size() ? mTopCells[next].node : (int)mNodes.size();
+	node.begin = (int)top.begin;
+	node.count = (int)(top.end - top.begin);
+	return next;
+}
+
+// Set a node's centre of mass and opening distance
+void NBodySystem::setNodeMass(Node &node, float cx, float cy, float cz, float m, const float bounds[6]) const {
+	// Centre of mass (geometric centre if massless)
+	float centre[3] = {0.5f * (bounds[0] + bounds[3]), 0.5f * (bounds[1] + bounds[4]), 0.5f * (bounds[2] + bounds[5])};
+	if(m > 0.0f) {
+		cx /= m;
+		cy /= m;
+		cz /= m;
+	} else {
+		cx = centre[0];
+		cy = centre[1];
+		cz = centre[2];
+	}
+
+	// Open when closer than size / theta plus the offset of the centre of mass
+	// from the cell centre (guards against lopsided cells)
+	float size = std::max(bounds[3] - bounds[0], std::max(bounds[4] - bounds[1], bounds[5] - bounds[2]));
+	float offset = sqrtf((cx - centre[0]) * (cx - centre[0]) + (cy - centre[1]) * (cy - centre[1]) + (cz - centre[2]) * (cz - centre[2]));
+	float radius = size / mTheta + offset;
+
+	node.x = cx;
+	node.y = cy;
+	node.z = cz;
+	node.mass = m;
+	node.open2 = radius * radius;
+}
+
+// Build the subtree for sorted particles [begin, end)
+int NBodySystem::buildNode(AlignedArray<Node> &nodes, AlignedArray<Group> &groups, size_t begin, size_t end, int level, bool in_group, float bounds[6]) const {
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+
+	float cx = 0.0f, cy = 0.0f, cz = 0.0f, m = 0.0f;
+
+	// The first cell small enough on the way down starts a group - as does a
+	// leaf at the deepest level, which holds any number of coincident particles
+	bool leaf = end - begin <= (size_t)LEAF_SIZE || level == MORTON_LEVELS;
+	bool group = !in_group && (end - begin <= (size_t)GROUP_SIZE || leaf);
+
+	if(leaf) {
+		// Leaf - sum the particles
+		bounds[0] = bounds[3] = x[begin];
+		bounds[1] = bounds[4] = y[begin];
+		bounds[2] = bounds[5] = z[begin];
+		for(size_t i = begin; i < end; i++) {
+			cx += x[i] * mass[i];
+			cy += y[i] * mass[i];
+			cz += z[i] * mass[i];
+			m += mass[i];
+			bounds[0] = std::min(bounds[0], x[i]);  bounds[3] = std::max(bounds[3], x[i]);
+			bounds[1] = std::min(bounds[1], y[i]);  bounds[4] = std::max(bounds[4], y[i]);
+			bounds[2] = std::min(bounds[2], z[i]);  bounds[5] = std::max(bounds[5], z[i]);
+		}
+	} else {
+		// Children - one per occupied octant, each a sub-range of the sorted codes
+		bool first = true;
+		size_t child_begin = begin;
+		while(child_begin < end) {
+			int digit = octant(mCodes[child_begin], level);
+			size_t child_end = std::partition_point(&mCodes[child_begin], &mCodes[0] + end, [&](uint64_t code) {
+				return octant(code, level) == digit;
+			}) - &mCodes[0];
+
+			float child_bounds[6];
+			const Node &child = nodes[buildNode(nodes, groups, child_begin, child_end, level + 1, in_group || group, child_bounds)];
+			cx += child.x * child.mass;
+			cy += child.y * child.mass;
+			cz += child.z * child.mass;
+			m += child.mass;
+			for(int a = 0; a < 3; a++) {
+				bounds[a]     = first ? child_bounds[a]     : std::min(bounds[a], child_bounds[a]);
+				bounds[a + 3] = first ? child_bounds[a + 3] : std::max(bounds[a + 3], child_bounds[a + 3]);
+			}
+			first = false;
+			child_begin = child_end;
+		}
+	}
+
+	Node &node = nodes[index];
+	setNodeMass(node, cx, cy, cz, m, bounds);
+	node.next = (int)nodes.size();
+	node.begin = (int)begin;
+	node.count = (int)(end - begin);
+
+	// Groups are listed in particle order
+	if(group) {
+		Group g;
+		g.node = index;
+		memcpy(g.bounds, bounds, sizeof(g.bounds));
+		groups.push_back(g);
+	}
+
+	return index;
+}
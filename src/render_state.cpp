@@ -0,0 +1,266 @@
+// System Headers
+#include <algorithm>
+
+// Project Headers
+#include "render_state.h"
+#include "geometry.h"
+
+// Tracked capabilities
+static const GLenum CAPABILITIES[RenderState::NUM_CAPABILITIES] = {GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_MULTISAMPLE, GL_PRIMITIVE_RESTART};
+
+// Tracked texture targets
+static const GLenum TEXTURE_TARGETS[RenderState::NUM_TEXTURE_TARGETS] = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP};
+
+// --------------------------------------------------------------------------------
+// Render State
+// --------------------------------------------------------------------------------
+// Constructor
+RenderState::RenderState() {
+	// Nothing known about the context yet
+	invalidate();
+
+	// Clear counters
+	resetStats();
+}
+
+// Forget the shadow copy
+void RenderState::invalidate() {
+	mProgram = 0;
+	mVertexArray = 0;
+	mActiveTexture = GL_TEXTURE0;
+	mRestartIndex = 0;
+	mProgramValid = false;
+	mVertexArrayValid = false;
+	mActiveTextureValid = false;
+	mRestartIndexValid = false;
+
+	for(int u = 0; u < MAX_TEXTURE_UNITS; u++) {
+		for(int t = 0; t < NUM_TEXTURE_TARGETS; t++) {
+			mTextures[u][t] = 0;
+			mTextureValid[u][t] = false;
+		}
+	}
+
+	// -1 - unknown, 0 - disabled, 1 - enabled
+	for(int c = 0; c < NUM_CAPABILITIES; c++) {
+		mCapabilities[c] = -1;
+	}
+}
+
+// Clear counters
+void RenderState::resetStats() {
+	mStats.issued = 0;
+	mStats.elided = 0;
+}
+
+// Bind program
+void RenderState::useProgram(GLuint program) {
+	if(mProgramValid && mProgram == program) {
+		mStats.elided++;
+		return;
+	}
+
+	glUseProgram(program);
+	mProgram = program;
+	mProgramValid = true;
+	mStats.issued++;
+}
+
+// Bind vertex array
+void RenderState::bindVertexArray(GLuint vao) {
+	if(mVertexArrayValid && mVertexArray == vao) {
+		mStats.elided++;
+		return;
+	}
+
+	glBindVertexArray(vao);
+	mVertexArray = vao;
+	mVertexArrayValid = true;
+	mStats.issued++;
+}
+
+// Select active texture unit
+void RenderState::activeTexture(GLenum unit) {
+	if(mActiveTextureValid && mActiveTexture == unit) {
+		mStats.elided++;
+		return;
+	}
+
+	glActiveTexture(unit);
+	mActiveTexture = unit;
+	mActiveTextureValid = true;
+	mStats.issued++;
+}
+
+// Bind texture to the active unit
+void RenderState::bindTexture(GLenum target, GLuint texture) {
+	int u = (int)mActiveTexture - (int)GL_TEXTURE0;
+	int t = textureTargetIndex(target);
+
+	// Active unit unknown or untracked unit/target - always issue
+	if(!mActiveTextureValid || u < 0 || u >= MAX_TEXTURE_UNITS || t < 0) {
+		glBindTexture(target, texture);
+		mStats.issued++;
+		return;
+	}
+
+	if(mTextureValid[u][t] && mTextures[u][t] == texture) {
+		mStats.elided++;
+		return;
+	}
+
+	glBindTexture(target, texture);
+	mTextures[u][t] = texture;
+	mTextureValid[u][t] = true;
+	mStats.issued++;
+}
+
+// Enable capability
+void RenderState::enable(GLenum cap) {
+	setCapability(cap, true);
+}
+
+// Disable capability
+void RenderState::disable(GLenum cap) {
+	setCapability(cap, false);
+}
+
+// Set the index that restarts a primitive
+void RenderState::primitiveRestartIndex(GLuint index) {
+	if(mRestartIndexValid && mRestartIndex == index) {
+		mStats.elided++;
+		return;
+	}
+
+	glPrimitiveRestartIndex(index);
+	mRestartIndex = index;
+	mRestartIndexValid = true;
+	mStats.issued++;
+}
+
+// Set a tracked capability
+void RenderState::setCapability(GLenum cap, bool on) {
+	int c = capabilityIndex(cap);
+
+	if(c >= 0 && mCapabilities[c] == (on ? 1 : 0)) {
+		mStats.elided++;
+		return;
+	}
+
+	if(on) {
+		glEnable(cap);
+	} else {
+		glDisable(cap);
+	}
+
+	if(c >= 0) {
+		mCapabilities[c] = on ? 1 : 0;
+	}
+	mStats.issued++;
+}
+
+// Shadow slot for a texture target
+int RenderState::textureTargetIndex(GLenum target) {
+	for(int t = 0; t < NUM_TEXTURE_TARGETS; t++) {
+		if(TEXTURE_TARGETS[t] == target) {
+			return t;
+		}
+	}
+	return -1;
+}
+
+// Shadow slot for a capability
+int RenderState::capabilityIndex(GLenum cap) {
+	for(int c = 0; c < NUM_CAPABILITIES; c++) {
+		if(CAPABILITIES[c] == cap) {
+			return c;
+		}
+	}
+	return -1;
+}
+
+// --------------------------------------------------------------------------------
+// Draw List
+// --------------------------------------------------------------------------------
+// Sort order - pass, then program, then texture, then VAO
+static bool compareDrawCommands(const DrawCommand &a, const DrawCommand &b) {
+	if(a.pass != b.pass) return a.pass < b.pass;
+	if(a.program != b.program) return a.program < b.program;
+	if(a.texture != b.texture) return a.texture < b.texture;
+	return a.vao < b.vao;
+}
+
+// Sort queued draws to minimise state changes
+void DrawList::sort() {
+	// Stable - equal keys keep submission order
+	std::stable_sort(mCommands.begin(), mCommands.end(), compareDrawCommands);
+}
+
+// Issue queued draws through the state tracker
+void DrawList::execute(RenderState &state) const {
+	for(size_t i = 0; i < mCommands.size(); i++) {
+		const DrawCommand &command = mCommands[i];
+
+		// State
+		state.useProgram(command.program);
+		if(command.depth_test) {
+			state.enable(GL_DEPTH_TEST);
+		} else {
+			state.disable(GL_DEPTH_TEST);
+		}
+		if(command.primitive_restart) {
+			// Largest index of the type - every other index is a vertex
+			state.enable(GL_PRIMITIVE_RESTART);
+			state.primitiveRestartIndex(::primitiveRestartIndex(command.type));
+		} else {
+			state.disable(GL_PRIMITIVE_RESTART);
+		}
+		state.activeTexture(GL_TEXTURE0);
+		state.bindTexture(command.texture_target, command.texture);
+		state.bindVertexArray(command.vao);
+
+		// Per-draw uniforms
+		if(command.model_location >= 0) {
+			glUniformMatrix4fv(command.model_location, 1, GL_FALSE, command.model);
+		}
+		if(command.layer_location >= 0) {
+			glUniform1f(command.layer_location, command.layer);
+		}
+
+		// Draw
+		if(command.type == 0) {
+			glDrawArrays(command.mode, command.first, command.count);
+			continue;
+		}
+
+		// Byte offset of the first index
+		GLsizei index_size = command.type == GL_UNSIGNED_BYTE ? 1 : (command.type == GL_UNSIGNED_SHORT ? 2 : 4);
+		const GLvoid *offset = (const GLvoid*)((size_t)command.first * index_size);
+		if(command.instances > 1) {
+			glDrawElementsInstanced(command.mode, command.count, command.type, offset, command.instances);
+		} else {
+			glDrawElements(command.mode, command.count, command.type, offset);
+		}
+	}
+}
+
+// Make a draw command with no per-draw uniforms
+DrawCommand makeDrawCommand(int pass, GLuint program, GLenum texture_target, GLuint texture, GLuint vao, GLsizei count) {
+	DrawCommand command;
+	command.pass = pass;
+	command.program = program;
+	command.texture_target = texture_target;
+	command.texture = texture;
+	command.vao = vao;
+	command.depth_test = true;
+	command.primitive_restart = false;
+	command.model_location = -1;
+	command.layer_location = -1;
+	command.layer = 0.0f;
+	command.mode = GL_TRIANGLES;
+	command.first = 0;
+	command.count = count;
+	command.type = GL_UNSIGNED_INT;
+	command.instances = 1;
+	return command;
+}
@@ -0,0 +1,103 @@
+// System Headers
+#include <cstring>
+
+// Project Headers
+#include "scene_graph.h"
+
+// --------------------------------------------------------------------------------
+// Scene Graph
+// --------------------------------------------------------------------------------
+// Reserve space for count nodes
+void SceneGraph::reserve(size_t count) {
+	mParent.reserve(count);
+	mDirty.reserve(count);
+	mLocal.reserve(count);
+	mWorld.reserve(count);
+}
+
+// Add a node under parent
+int SceneGraph::addNode(int parent) {
+	int node = (int)size();
+
+	// Parents must already exist so one pass in index order visits them first
+	if(parent >= node) {
+		std::cerr << "Error: scene node " << node << " added before its parent " << parent << std::endl;
+		return INVALID_NODE;
+	}
+
+	mParent.push_back(parent < 0 ? -1 : parent);
+	mDirty.push_back(1);
+
+	// Identity local and world
+	mLocal.resize(node + 1);
+	mWorld.resize(node + 1);
+	identity(mLocal[node].m);
+	identity(mWorld[node].m);
+
+	return node;
+}
+
+// Remove all nodes
+void SceneGraph::clear() {
+	mParent.clear();
+	mDirty.clear();
+	mLocal.clear();
+	mWorld.clear();
+	mUpdated = 0;
+}
+
+// Set the local matrix
+void SceneGraph::setLocal(int node, const float local[16]) {
+	memcpy(getLocal(node), local, 16 * sizeof(float));
+	mDirty[node] = 1;
+}
+
+// Set the local matrix to a translation
+void SceneGraph::setLocalTranslation(int node, float x, float y, float z) {
+	float translation[16];
+	translate(x, y, z, translation);
+
+	// Nodes that have not moved stay clean
+	if(memcmp(getLocal(node), translation, sizeof(translation)) == 0) {
+		return;
+	}
+
+	setLocal(node, translation);
+}
+
+// Recompute dirty world matrices
+size_t SceneGraph::update() {
+	const size_t count = size();
+	const int *parent = mParent.data();
+	uint8_t *dirty = mDirty.data();
+	const Matrix44 *local = mLocal.data();
+	Matrix44 *world = mWorld.data();
+
+	mUpdated = 0;
+	for(size_t i = 0; i < count; i++) {
+		int p = parent[i];
+
+		// A moved parent moves every descendant (the parent's flag is final - it came first)
+		if(p >= 0) {
+			dirty[i] |= dirty[p];
+		}
+		if(!dirty[i]) {
+			continue;
+		}
+
+		// World = parent world * local (SIMD multiply)
+		if(p >= 0) {
+			multiply44(world[p], local[i], world[i]);
+		} else {
+			world[i] = local[i];
+		}
+		mUpdated++;
+	}
+
+	// Everything is clean until the next change
+	if(count > 0) {
+		memset(dirty, 0, count);
+	}
+
+	return mUpdated;
+}
@@ -232,3 +232,136 @@ GLuint loadProgram(const char *vert_file, const char *ctrl_file, const char *eva
 	// Return program
 	return program;
 }
+
+// Create a uniform buffer of size bytes attached to a uniform block binding point
+GLuint createUniformBuffer(GLsizeiptr size, GLuint binding) {
+	// Uniform Buffer
+	GLuint buffer = 0;
+
+	// Create buffer storage (contents written each frame)
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Attach to binding point
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+
+	return buffer;
+}
+
+// --------------------------------------------------------------------------------
+// Program Wrapper
+// --------------------------------------------------------------------------------
+// Constructor
+Program::Program() : mProgram(0) {}
+
+Program::Program(const char *vert_file, const char *ctrl_file, const char *eval_file, const char *geom_file, const char *frag_file) : mProgram(0) {
+	load(vert_file, ctrl_file, eval_file, geom_file, frag_file);
+}
+
+// Load, link and reflect program
+bool Program::load(const char *vert_file, const char *ctrl_file, const char *eval_file, const char *geom_file, const char *frag_file) {
+	// Release any previous program
+	destroy();
+
+	// Load and link
+	mProgram = loadProgram(vert_file, ctrl_file, eval_file, geom_file, frag_file);
+
+	// Check program
+	if(mProgram == 0) {
+		return false;
+	}
+
+	// Build uniform table
+	reflect();
+
+	return true;
+}
+
+// Delete program
+void Program::destroy() {
+	if(mProgram != 0) {
+		glDeleteProgram(mProgram);
+	}
+
+	mProgram = 0;
+	mUniforms.clear();
+}
+
+// Attach a uniform block to a binding point
+bool Program::bindUniformBlock(const char *name, GLuint binding) const {
+	// Find block
+	GLuint index = glGetUniformBlockIndex(mProgram, name);
+
+	// Not active (or optimised out)
+	if(index == GL_INVALID_INDEX) {
+		return false;
+	}
+
+	// Set binding point
+	glUniformBlockBinding(mProgram, index, binding);
+
+	return true;
+}
+
+// Look up a reflected uniform location
+GLint Program::getUniformLocation(const std::string &name) const {
+	std::map<std::string, Uniform>::const_iterator it = mUniforms.find(name);
+
+	// Not active (or optimised out)
+	if(it == mUniforms.end()) {
+		return -1;
+	}
+
+	return it->second.location;
+}
+
+// Look up a reflected uniform
+const Uniform* Program::getUniform(const std::string &name) const {
+	std::map<std::string, Uniform>::const_iterator it = mUniforms.find(name);
+
+	// Not active (or optimised out)
+	if(it == mUniforms.end()) {
+		return NULL;
+	}
+
+	return &it->second;
+}
+
+// Query active uniforms
+void Program::reflect() {
+	// Number of active uniforms and longest name
+	GLint count = 0;
+	GLint max_length = 0;
+	glGetProgramiv(mProgram, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+	// Name buffer
+	char *name = new char[max_length + 1];
+
+	for(GLint i = 0; i < count; i++) {
+		// Get uniform description
+		GLsizei length = 0;
+		Uniform uniform;
+		glGetActiveUniform(mProgram, i, max_length + 1, &length, &uniform.size, &uniform.type, name);
+
+		// Uniforms in a block have no location
+		uniform.location = glGetUniformLocation(mProgram, name);
+		if(uniform.location < 0) {
+			continue;
+		}
+
+		// Store under the reported name
+		std::string key(name, length);
+		mUniforms[key] = uniform;
+
+		// Arrays are reported as "name[0]" - also store under "name"
+		if(key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+			mUniforms[key.substr(0, key.size() - 3)] = uniform;
+		}
+	}
+
+	// Delete name buffer
+	delete[] name;
+}
@@ -0,0 +1,43 @@
+// Project Headers
+#include "simulation.h"
+
+// --------------------------------------------------------------------------------
+// Simulation Clock
+// --------------------------------------------------------------------------------
+// Constructor
+SimulationClock::SimulationClock(double step) {
+	mStep = step;
+	mAccumulator = 0.0;
+	mTimeScale = 1.0;
+	mMaxFrameTime = 0.25;
+	mStepCount = 0;
+	mPaused = false;
+}
+
+// Add real elapsed seconds and return the number of steps to simulate
+unsigned long SimulationClock::advance(double real_dt) {
+	// Nothing moves while paused
+	if(mPaused) {
+		return 0;
+	}
+
+	// Clamp long frames
+	if(real_dt > mMaxFrameTime) {
+		real_dt = mMaxFrameTime;
+	} else if(real_dt < 0.0) {
+		real_dt = 0.0;
+	}
+
+	// Accumulate scaled time
+	mAccumulator += real_dt * mTimeScale;
+
+	// Consume whole steps
+	unsigned long steps = (unsigned long)(mAccumulator / mStep);
+	mAccumulator -= steps * mStep;
+	if(mAccumulator < 0.0) {
+		mAccumulator = 0.0;
+	}
+	mStepCount += steps;
+
+	return steps;
+}
@@ -0,0 +1,215 @@
+// System Headers
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// Project Headers
+#include "simulation_thread.h"
+
+// --------------------------------------------------------------------------------
+// Simulation Thread
+// --------------------------------------------------------------------------------
+// Constructor
+SimulationThread::SimulationThread(SimulationClock &clock, BodyTable &bodies, SceneGraph &scene, JobSystem &jobs, NBodySystem *particles) :
+	mClock(clock), mBodies(bodies), mScene(scene), mJobs(jobs), mParticles(particles), mLastTime(0.0), mDroppedParticleTime(0.0), mPublished(0), mStop(false) {
+	// State at the current step so the renderer has something to draw straight away
+	double time = mClock.getTime();
+	evaluateBodies(mBodies, time, mJobs);
+	updateBodyTransforms(mBodies, mScene, mJobs);
+	publish();
+}
+
+SimulationThread::~SimulationThread() {
+	stop();
+}
+
+// Run the simulation on its own thread
+void SimulationThread::start() {
+	if(isRunning()) {
+		return;
+	}
+	mStop = false;
+	mThread = std::thread(&SimulationThread::threadLoop, this);
+}
+
+// Stop and join the thread
+void SimulationThread::stop() {
+	if(!isRunning()) {
+		return;
+	}
+	mStop = true;
+	mThread.join();
+}
+
+// Advance by real seconds
+void SimulationThread::advance(double real_dt) {
+	unsigned long steps = mClock.advance(real_dt);
+	if(steps == 0) {
+		return;
+	}
+
+	// Particles take the steps due at the fixed step size, at most
+	// MAX_PARTICLE_STEPS of them - the rest are dropped for the particles only
+	if(mParticles != NULL) {
+		unsigned long particle_steps = steps < MAX_PARTICLE_STEPS ? steps : MAX_PARTICLE_STEPS;
+		float dt = (float)mClock.getStep();
+		for(unsigned long i = 0; i < particle_steps; i++) {
+			mParticles->step(dt, mJobs);
+		}
+		mDroppedParticleTime += (steps - particle_steps) * mClock.getStep();
+	}
+
+	// Orbits are closed form, so only the latest step is evaluated - warped runs skip the steps in between
+	evaluateBodies(mBodies, mClock.getTimeAt(mClock.getStepCount()), mJobs);
+	updateBodyTransforms(mBodies, mScene, mJobs);
+	publish();
+}
+
+// Latest complete snapshot
+const SceneSnapshot &SimulationThread::acquire() {
+	mSnapshots.acquire();
+	return mSnapshots.getFront();
+}
+
+// Fraction of the way from a snapshot's previous state to its latest one to draw now
+double SimulationThread::getAlpha(const SceneSnapshot &snapshot) const {
+	double span = snapshot.time - snapshot.previous_time;
+	if(span <= 0.0) {
+		return 1.0;
+	}
+
+	// Simulation time that has passed since the latest step
+	double ahead = snapshot.leftover;
+	if(isRunning() && !mClock.isPaused()) {
+		double real = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.published).count();
+		ahead += real * mClock.getTimeScale();
+	}
+
+	double alpha = ahead / span;
+	return alpha < 1.0 ? alpha : 1.0;
+}
+
+// Copy the bodies into the back snapshot and publish it
+void SimulationThread::publish() {
+	SceneSnapshot &snapshot = mSnapshots.getBack();
+	size_t count = mBodies.size();
+
+	// Slots keep their storage so this only allocates the first time round
+	snapshot.x.resize(count);
+	snapshot.y.resize(count);
+	snapshot.z.resize(count);
+	snapshot.spin_speed.resize(count);
+	snapshot.radius.resize(count);
+	snapshot.layer.resize(count);
+	if(count > 0) {
+		// World centres from the model matrices (orbit centre nodes only translate)
+		for(size_t i = 0; i < count; i++) {
+			snapshot.x[i] = mBodies.model[i * 16 + 12];
+			snapshot.y[i] = mBodies.model[i * 16 + 13];
+			snapshot.z[i] = mBodies.model[i * 16 + 14];
+		}
+		memcpy(snapshot.spin_speed.data(), mBodies.spin_speed.data(), count * sizeof(float));
+		memcpy(snapshot.radius.data(), mBodies.radius.data(), count * sizeof(float));
+		memcpy(snapshot.layer.data(), mBodies.layer.data(), count * sizeof(int));
+	}
+
+	// Particle positions interleaved for the vertex buffer, in the order they
+	// were added (the system re-sorts them every step) so snapshots line up
+	size_t particle_count = mParticles != NULL ? mParticles->size() : 0;
+	snapshot.particles.resize(particle_count * 3);
+	if(particle_count > 0) {
+		const NBodySystem &particles = *mParticles;
+		float *positions = snapshot.particles.data();
+		mJobs.parallelFor(particle_count, PARTICLE_GRAIN, [&](size_t begin, size_t end) {
+			for(size_t i = begin; i < end; i++) {
+				float *p = &positions[particles.id[i] * 3];
+				p[0] = particles.x[i];
+				p[1] = particles.y[i];
+				p[2] = particles.z[i];
+			}
+		});
+	}
+
+	// Previous state is the last one published (the latest one the first time round)
+	snapshot.previous_x.resize(count);
+	snapshot.previous_y.resize(count);
+	snapshot.previous_z.resize(count);
+	snapshot.previous_spin.resize(count);
+	snapshot.previous_particles.resize(particle_count * 3);
+	bool first = mLastSpin.size() != count || mLastParticles.size() != particle_count * 3;
+	if(count > 0) {
+		memcpy(snapshot.previous_x.data(), first ? snapshot.x.data() : mLastX.data(), count * sizeof(float));
+		memcpy(snapshot.previous_y.data(), first ? snapshot.y.data() : mLastY.data(), count * sizeof(float));
+		memcpy(snapshot.previous_z.data(), first ? snapshot.z.data() : mLastZ.data(), count * sizeof(float));
+		memcpy(snapshot.previous_spin.data(), first ? mBodies.spin.data() : mLastSpin.data(), count * sizeof(float));
+	}
+	if(particle_count > 0) {
+		memcpy(snapshot.previous_particles.data(), first ? snapshot.particles.data() : mLastParticles.data(), particle_count * 3 * sizeof(float));
+	}
+	mLastX = snapshot.x;
+	mLastY = snapshot.y;
+	mLastZ = snapshot.z;
+	mLastSpin = mBodies.spin;
+	mLastParticles = snapshot.particles;
+
+	snapshot.time = mClock.getTime();
+	snapshot.previous_time = first ? snapshot.time : mLastTime;
+	snapshot.leftover = mClock.getAlpha() * mClock.getStep();
+	snapshot.step = mClock.getStepCount();
+	snapshot.published = std::chrono::steady_clock::now();
+	mLastTime = snapshot.time;
+
+	mSnapshots.publish();
+	mPublished++;
+}
+
+// Compose model matrices part way between a snapshot's two states
+void interpolateBodies(const SceneSnapshot &snapshot, float alpha, float *model, JobSystem &jobs) {
+	const double TWO_PI = 2.0 * M_PI;
+
+	// Simulation seconds since the previous state (spins are advanced by this,
+	// not blended, so a turn of more than half a revolution between steps is kept)
+	const double elapsed = (snapshot.time - snapshot.previous_time) * alpha;
+
+	jobs.parallelFor(snapshot.radius.size(), BODY_GRAIN, [&](size_t begin, size_t end) {
+		// State at this moment for up to BODY_GRAIN bodies at a time
+		float x[BODY_GRAIN], y[BODY_GRAIN], z[BODY_GRAIN], spin[BODY_GRAIN];
+		for(size_t first = begin; first < end; first += BODY_GRAIN) {
+			size_t n = std::min(end - first, BODY_GRAIN);
+			for(size_t j = 0; j < n; j++) {
+				size_t i = first + j;
+				x[j] = snapshot.previous_x[i] + (snapshot.x[i] - snapshot.previous_x[i]) * alpha;
+				y[j] = snapshot.previous_y[i] + (snapshot.y[i] - snapshot.previous_y[i]) * alpha;
+				z[j] = snapshot.previous_z[i] + (snapshot.z[i] - snapshot.previous_z[i]) * alpha;
+				spin[j] = (float)fmod(snapshot.previous_spin[i] + elapsed * snapshot.spin_speed[i], TWO_PI);
+			}
+
+			// translate(centre) * rotateY(spin) * scale(radius) in one batch
+			composeBodyTransforms(x, y, z, spin, &snapshot.radius[first], &model[first * 16], n);
+		}
+	});
+}
+
+// Thread body
+void SimulationThread::threadLoop() {
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+	while(!mStop) {
+		// Advance by the real time since the last pass
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		advance(std::chrono::duration<double>(now - last).count());
+		last = now;
+
+		// Sleep until the next step is due (at most one step while paused or slowed down)
+		double wait = mClock.getStep();
+		double scale = mClock.getTimeScale();
+		if(!mClock.isPaused() && scale > 0.0) {
+			wait = (1.0 - mClock.getAlpha()) * mClock.getStep() / scale;
+			if(wait > mClock.getStep()) {
+				wait = mClock.getStep();
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+	}
+}
@@ -1,92 +1,266 @@
 #include "transforms.h"
+#include "simd.h"
 
-void translate(float tx, float ty, float tz, float T[16]) {
-	T[0]  = 1.0f;  T[4]  = 0.0f;  T[8]  = 0.0f;  T[12] = tx;
-	T[1]  = 0.0f;  T[5]  = 1.0f;  T[9]  = 0.0f;  T[13] = ty;
-	T[2]  = 0.0f;  T[6]  = 0.0f;  T[10] = 1.0f;  T[14] = tz;
-	T[3]  = 0.0f;  T[7]  = 0.0f;  T[11] = 0.0f;  T[15] = 1.0f;
-}
-
-void multiply44(float a[16], float b[16], float c[16]) {
-	// Multiply each row of A with each column of B to give C
-	c[0]  = a[0]*b[0]  + a[4]*b[1]  + a[8]*b[2]   + a[12]*b[3];
-	c[4]  = a[0]*b[4]  + a[4]*b[5]  + a[8]*b[6]   + a[12]*b[7];
-	c[8]  = a[0]*b[8]  + a[4]*b[9]  + a[8]*b[10]  + a[12]*b[11];
-	c[12] = a[0]*b[12] + a[4]*b[13] + a[8]*b[14]  + a[12]*b[15];
-
-	c[1]  = a[1]*b[0]  + a[5]*b[1]  + a[9]*b[2]   + a[13]*b[3];
-	c[5]  = a[1]*b[4]  + a[5]*b[5]  + a[9]*b[6]   + a[13]*b[7];
-	c[9]  = a[1]*b[8]  + a[5]*b[9]  + a[9]*b[10]  + a[13]*b[11];
-	c[13] = a[1]*b[12] + a[5]*b[13] + a[9]*b[14]  + a[13]*b[15];
-
-	c[2]  = a[2]*b[0]  + a[6]*b[1]  + a[10]*b[2]  + a[14]*b[3];
-	c[6]  = a[2]*b[4]  + a[6]*b[5]  + a[10]*b[6]  + a[14]*b[7];
-	c[10] = a[2]*b[8]  + a[6]*b[9]  + a[10]*b[10] + a[14]*b[11];
-	c[14] = a[2]*b[12] + a[6]*b[13] + a[10]*b[14] + a[14]*b[15];
-
-	c[3]  = a[3]*b[0]  + a[7]*b[1]  + a[11]*b[2]  + a[15]*b[3];
-	c[7]  = a[3]*b[4]  + a[7]*b[5]  + a[11]*b[6]  + a[15]*b[7];
-	c[11] = a[3]*b[8]  + a[7]*b[9]  + a[11]*b[10] + a[15]*b[11];
-	c[15] = a[3]*b[12] + a[7]*b[13] + a[11]*b[14] + a[15]*b[15];
-}
-
-// Create a rotation matrix around the X-axis
-void rotateX(float theta, float Rx[16]) {
-	// Calculate sin(theta) and cos(theta)
-	float sinTheta = sin(theta);
-	float cosTheta = cos(theta);
-
-	Rx[0]  = 1.0f;  Rx[4]  = 0.0f;      Rx[8]  =      0.0f;  Rx[12] = 0.0f;
-	Rx[1]  = 0.0f;  Rx[5]  = cosTheta;  Rx[9]  = -sinTheta;  Rx[13] = 0.0f;
-	Rx[2]  = 0.0f;  Rx[6]  = sinTheta;  Rx[10] =  cosTheta;  Rx[14] = 0.0f;
-	Rx[3]  = 0.0f;  Rx[7]  = 0.0f;      Rx[11] =      0.0f;  Rx[15] = 1.0f;
-}
-
-// Create a rotation matrix around the Y-axis
-void rotateY(float theta, float Ry[16]) {
-	// Calculate sin(theta) and cos(theta)
-	float sinTheta = sin(theta);
-	float cosTheta = cos(theta);
-
-	Ry[0]  =  cosTheta;  Ry[4]  = 0.0f;  Ry[8]  =  sinTheta;  Ry[12] = 0.0f;
-	Ry[1]  =  0.0f;      Ry[5]  = 1.0f;  Ry[9]  =      0.0f;  Ry[13] = 0.0f;
-	Ry[2]  = -sinTheta;  Ry[6]  = 0.0f;  Ry[10] =  cosTheta;  Ry[14] = 0.0f;
-	Ry[3]  =  0.0f;      Ry[7]  = 0.0f;  Ry[11] =      0.0f;  Ry[15] = 1.0f;
-}
-
-// Create a rotation matrix around the Z-axis
-void rotateZ(float theta, float Rz[16]) {
-	// Calculate sin(theta) and cos(theta)
-	float sinTheta = sin(theta);
-	float cosTheta = cos(theta);
-
-	Rz[0]  = cosTheta;  Rz[4]  = -sinTheta;  Rz[8]  = 0.0f;  Rz[12] = 0.0f;
-	Rz[1]  = sinTheta;  Rz[5]  =  cosTheta;  Rz[9]  = 0.0f;  Rz[13] = 0.0f;
-	Rz[2]  = 0.0f;      Rz[6]  =  0.0f;      Rz[10] = 1.0f;  Rz[14] = 0.0f;
-	Rz[3]  = 0.0f;      Rz[7]  =  0.0f;      Rz[11] = 0.0f;  Rz[15] = 1.0f;
-}
-
-// Create a rotation matrix around arbitrary axis (rx, ry, rz)
-void rotate(float theta, float rx, float ry, float rz, float R[16]) {
-	// Calculate sin(theta) and cos(theta)
-	float sinTheta = sin(theta);
-	float cosTheta = cos(theta);
-
-	float l = sqrt(rx*rx + ry*ry + rz*rz);
-	rx /= l;
-	ry /= l;
-	rz /= l;
-
-	R[0]  = cosTheta + (1-cosTheta)*rx*rx;     R[4]  = (1-cosTheta)*rx*ry - rz*sinTheta;  R[8]  = (1 - cosTheta)*rx*ry + ry*sinTheta;  R[12] = 0.0f;
-	R[1]  = (1-cosTheta)*rx*ry + rz*sinTheta;  R[5]  = cosTheta + (1-cosTheta)*ry*ry;     R[9]  = (1 - cosTheta)*ry*rz - rx*sinTheta;  R[13] = 0.0f;
-	R[2]  = (1-cosTheta)*rx*rz - ry*sinTheta;  R[6]  = (1-cosTheta)*ry*rz + rx*sinTheta;  R[10] = cosTheta + (1-cosTheta)*rz*rz;       R[14] = 0.0f;
-	R[3]  = 0.0f;                              R[7]  = 0.0f;                              R[11] = 0.0f;                                R[15] = 1.0f;
-}
-
-void scale(float sx, float sy, float sz, float S[16]) {
-	// Scaling Matrix
-	S[0]  = sx;    S[4]  =  0.0f;  S[8]  = 0.0f;  S[12] = 0.0f;
-	S[1]  = 0.0f;  S[5]  =  sy;    S[9]  = 0.0f;  S[13] = 0.0f;
-	S[2]  = 0.0f;  S[6]  =  0.0f;  S[10] = sz;    S[14] = 0.0f;
-	S[3]  = 0.0f;  S[7]  =  0.0f;  S[11] = 0.0f;  S[15] = 1.0f;
+// --------------------------------------------------------------------------------
+// Matrix Multiply
+// --------------------------------------------------------------------------------
+// Column j of c is a * (column j of b) - a weighted sum of the columns of a.
+// Every column of a is loaded before any store so c may alias a or b.
+
+// Scalar kernel
+static void multiply44Scalar(const Matrix44 &a, const Matrix44 &b, Matrix44 &c) {
+	Matrix44 result;
+	multiply44(a.m, b.m, result.m);
+	c = result;
+}
+
+#if defined(SIMD_X86)
+// SSE2 kernel - one column per register
+static void multiply44SSE2(const Matrix44 &a, const Matrix44 &b, Matrix44 &c) {
+	__m128 a0 = _mm_load_ps(&a.m[0]);
+	__m128 a1 = _mm_load_ps(&a.m[4]);
+	__m128 a2 = _mm_load_ps(&a.m[8]);
+	__m128 a3 = _mm_load_ps(&a.m[12]);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b.m[j]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b.m[j + 1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b.m[j + 2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b.m[j + 3])));
+		_mm_store_ps(&c.m[j], column);
+	}
+}
+
+// AVX2 kernel - two columns per register
+__attribute__((target("avx2")))
+static void multiply44AVX2(const Matrix44 &a, const Matrix44 &b, Matrix44 &c) {
+	// Each column of a in both halves
+	__m256 a0 = _mm256_broadcast_ps((const __m128*)&a.m[0]);
+	__m256 a1 = _mm256_broadcast_ps((const __m128*)&a.m[4]);
+	__m256 a2 = _mm256_broadcast_ps((const __m128*)&a.m[8]);
+	__m256 a3 = _mm256_broadcast_ps((const __m128*)&a.m[12]);
+
+	// Columns 0,1 and 2,3 of b (Matrix44 is only 16-byte aligned)
+	__m256 b01 = _mm256_loadu_ps(&b.m[0]);
+	__m256 b23 = _mm256_loadu_ps(&b.m[8]);
+
+	// Broadcast element k of each b column within its half
+	__m256 c01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+	c01 = _mm256_add_ps(c01, _mm256_mul_ps(a1, _mm256_permute_ps(b01, 0x55)));
+	c01 = _mm256_add_ps(c01, _mm256_mul_ps(a2, _mm256_permute_ps(b01, 0xAA)));
+	c01 = _mm256_add_ps(c01, _mm256_mul_ps(a3, _mm256_permute_ps(b01, 0xFF)));
+
+	__m256 c23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+	c23 = _mm256_add_ps(c23, _mm256_mul_ps(a1, _mm256_permute_ps(b23, 0x55)));
+	c23 = _mm256_add_ps(c23, _mm256_mul_ps(a2, _mm256_permute_ps(b23, 0xAA)));
+	c23 = _mm256_add_ps(c23, _mm256_mul_ps(a3, _mm256_permute_ps(b23, 0xFF)));
+
+	_mm256_storeu_ps(&c.m[0], c01);
+	_mm256_storeu_ps(&c.m[8], c23);
+}
+#endif // SIMD_X86
+
+#if defined(SIMD_NEON)
+// NEON kernel - one column per register
+static void multiply44NEON(const Matrix44 &a, const Matrix44 &b, Matrix44 &c) {
+	float32x4_t a0 = vld1q_f32(&a.m[0]);
+	float32x4_t a1 = vld1q_f32(&a.m[4]);
+	float32x4_t a2 = vld1q_f32(&a.m[8]);
+	float32x4_t a3 = vld1q_f32(&a.m[12]);
+
+	float32x4_t columns[4];
+	for(int j = 0; j < 4; j++) {
+		float32x4_t bj = vld1q_f32(&b.m[j * 4]);
+		columns[j] = vmulq_lane_f32(a0, vget_low_f32(bj), 0);
+		columns[j] = vmlaq_lane_f32(columns[j], a1, vget_low_f32(bj), 1);
+		columns[j] = vmlaq_lane_f32(columns[j], a2, vget_high_f32(bj), 0);
+		columns[j] = vmlaq_lane_f32(columns[j], a3, vget_high_f32(bj), 1);
+	}
+
+	for(int j = 0; j < 4; j++) {
+		vst1q_f32(&c.m[j * 4], columns[j]);
+	}
+}
+#endif // SIMD_NEON
+
+// --------------------------------------------------------------------------------
+// Body Transforms
+// --------------------------------------------------------------------------------
+// translate(x,y,z) * rotateY(s) * scale(r) - one sin/cos pair per body
+
+// Scalar kernel
+static void composeBodyTransformsScalar(const float *x, const float *y, const float *z, const float *spin, const float *radius, float *model, size_t count) {
+	for(size_t i = 0; i < count; i++) {
+		float sinA = sinf(spin[i]);
+		float cosA = cosf(spin[i]);
+		float r = radius[i];
+		float *M = &model[i * 16];
+
+		M[0]  =  r*cosA;  M[4]  = 0.0f;  M[8]  = r*sinA;  M[12] = x[i];
+		M[1]  =  0.0f;    M[5]  = r;     M[9]  = 0.0f;    M[13] = y[i];
+		M[2]  = -r*sinA;  M[6]  = 0.0f;  M[10] = r*cosA;  M[14] = z[i];
+		M[3]  =  0.0f;    M[7]  = 0.0f;  M[11] = 0.0f;    M[15] = 1.0f;
+	}
+}
+
+#if defined(SIMD_X86)
+// Transpose 4 rows (one element of 4 bodies each) into one column of each body
+static inline void storeColumns4(__m128 a, __m128 b, __m128 c, __m128 d, float *model, int column) {
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+	_mm_storeu_ps(&model[0 * 16 + column * 4], a);
+	_mm_storeu_ps(&model[1 * 16 + column * 4], b);
+	_mm_storeu_ps(&model[2 * 16 + column * 4], c);
+	_mm_storeu_ps(&model[3 * 16 + column * 4], d);
+}
+
+// Store translate(x,y,z) * rotateY(A) * scale(r) for 4 bodies from already computed sin/cos
+static inline void storeBodyTransforms4(__m128 sinA, __m128 cosA, __m128 r, __m128 x, __m128 y, __m128 z, float *model) {
+	const __m128 zero = _mm_setzero_ps();
+	__m128 rc = _mm_mul_ps(r, cosA);
+	__m128 rs = _mm_mul_ps(r, sinA);
+
+	storeColumns4(rc, zero, _mm_sub_ps(zero, rs), zero, model, 0);
+	storeColumns4(zero, r, zero, zero, model, 1);
+	storeColumns4(rs, zero, rc, zero, model, 2);
+	storeColumns4(x, y, z, _mm_set1_ps(1.0f), model, 3);
+}
+
+// SSE2 kernel - 4 bodies per iteration
+static void composeBodyTransformsSSE2(const float *x, const float *y, const float *z, const float *spin, const float *radius, float *model, size_t count) {
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 sinA, cosA;
+		sincos4(_mm_loadu_ps(&spin[i]), sinA, cosA);
+		storeBodyTransforms4(sinA, cosA, _mm_loadu_ps(&radius[i]), _mm_loadu_ps(&x[i]), _mm_loadu_ps(&y[i]), _mm_loadu_ps(&z[i]), &model[i * 16]);
+	}
+
+	// Remaining bodies
+	composeBodyTransformsScalar(&x[i], &y[i], &z[i], &spin[i], &radius[i], &model[i * 16], count - i);
+}
+
+// AVX2 kernel - 8 bodies per iteration (trig in 8 lanes, stored as two halves)
+__attribute__((target("avx2")))
+static void composeBodyTransformsAVX2(const float *x, const float *y, const float *z, const float *spin, const float *radius, float *model, size_t count) {
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 sinA, cosA;
+		sincos8(_mm256_loadu_ps(&spin[i]), sinA, cosA);
+
+		storeBodyTransforms4(_mm256_castps256_ps128(sinA), _mm256_castps256_ps128(cosA), _mm_loadu_ps(&radius[i]),
+		                     _mm_loadu_ps(&x[i]), _mm_loadu_ps(&y[i]), _mm_loadu_ps(&z[i]), &model[i * 16]);
+		storeBodyTransforms4(_mm256_extractf128_ps(sinA, 1), _mm256_extractf128_ps(cosA, 1), _mm_loadu_ps(&radius[i + 4]),
+		                     _mm_loadu_ps(&x[i + 4]), _mm_loadu_ps(&y[i + 4]), _mm_loadu_ps(&z[i + 4]), &model[(i + 4) * 16]);
+	}
+
+	// Remaining bodies
+	composeBodyTransformsSSE2(&x[i], &y[i], &z[i], &spin[i], &radius[i], &model[i * 16], count - i);
+}
+#endif // SIMD_X86
+
+// --------------------------------------------------------------------------------
+// Kernel Selection
+// --------------------------------------------------------------------------------
+// Check if this CPU can run a kernel
+bool isTransformKernelSupported(TransformKernel kernel) {
+	switch(kernel) {
+		case TRANSFORM_SCALAR:
+			return true;
+#if defined(SIMD_X86)
+		case TRANSFORM_SSE2:
+			return true;
+		case TRANSFORM_AVX2:
+			// May run before static constructors (see transform_kernel below)
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+#if defined(SIMD_NEON)
+		case TRANSFORM_NEON:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+// Best kernel supported by this CPU
+TransformKernel getBestTransformKernel() {
+	if(isTransformKernelSupported(TRANSFORM_AVX2)) {
+		return TRANSFORM_AVX2;
+	}
+	if(isTransformKernelSupported(TRANSFORM_SSE2)) {
+		return TRANSFORM_SSE2;
+	}
+	if(isTransformKernelSupported(TRANSFORM_NEON)) {
+		return TRANSFORM_NEON;
+	}
+	return TRANSFORM_SCALAR;
+}
+
+// Selected kernel
+static TransformKernel transform_kernel = getBestTransformKernel();
+
+// Kernel used by the SIMD functions
+TransformKernel getTransformKernel() {
+	return transform_kernel;
+}
+
+// Select the kernel used by the SIMD functions
+void setTransformKernel(TransformKernel kernel) {
+	// Never select a kernel this CPU cannot run
+	if(!isTransformKernelSupported(kernel)) {
+		std::cerr << "Error: " << getTransformKernelName(kernel) << " transforms not supported - using "
+		          << getTransformKernelName(getBestTransformKernel()) << std::endl;
+		kernel = getBestTransformKernel();
+	}
+	transform_kernel = kernel;
+}
+
+// Name of a kernel
+const char *getTransformKernelName(TransformKernel kernel) {
+	switch(kernel) {
+		case TRANSFORM_SSE2: return "sse2";
+		case TRANSFORM_AVX2: return "avx2";
+		case TRANSFORM_NEON: return "neon";
+		default:             return "scalar";
+	}
+}
+
+// Multiply a * b with the selected kernel
+void multiply44(const Matrix44 &a, const Matrix44 &b, Matrix44 &c) {
+	switch(transform_kernel) {
+#if defined(SIMD_X86)
+		case TRANSFORM_AVX2:
+			multiply44AVX2(a, b, c);
+			break;
+		case TRANSFORM_SSE2:
+			multiply44SSE2(a, b, c);
+			break;
+#endif
+#if defined(SIMD_NEON)
+		case TRANSFORM_NEON:
+			multiply44NEON(a, b, c);
+			break;
+#endif
+		default:
+			multiply44Scalar(a, b, c);
+			break;
+	}
+}
+
+// Compose count body transforms with the selected kernel
+void composeBodyTransforms(const float *x, const float *y, const float *z, const float *spin, const float *radius, float *model, size_t count) {
+	switch(transform_kernel) {
+#if defined(SIMD_X86)
+		case TRANSFORM_AVX2:
+			composeBodyTransformsAVX2(x, y, z, spin, radius, model, count);
+			break;
+		case TRANSFORM_SSE2:
+			composeBodyTransformsSSE2(x, y, z, spin, radius, model, count);
+			break;
+#endif
+		default:
+			// Scalar kernel on NEON and CPUs without SSE2
+			composeBodyTransformsScalar(x, y, z, spin, radius, model, count);
+			break;
+	}
 }
@@ -1,6 +1,12 @@
 // Project Headers 
 #include "utils.h"
 
+// EGL Headers (headless contexts)
+#if defined(__linux__)
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
 // --------------------------------------------------------------------------------
 // GLFW Functions
 // --------------------------------------------------------------------------------
@@ -35,4 +41,140 @@ GLFWwindow* createWindow(int width, int height, const char *title, int major, in
 
 	// Return GLFW window
 	return window;
-}
\ No newline at end of file
+}
+
+// --------------------------------------------------------------------------------
+// Headless Functions
+// --------------------------------------------------------------------------------
+
+// Create a surfaceless EGL context and make it current
+bool createHeadlessContext(HeadlessContext &headless, int major, int minor) {
+	headless.display = NULL;
+	headless.context = NULL;
+
+#if defined(__linux__)
+	// Prefer the Mesa surfaceless platform - needs no X server or GPU (llvmpipe)
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(getPlatformDisplay != NULL) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+
+	// Fall back to the default display
+	if(display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	// Initialise EGL
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		std::cerr << "Error: could not initialise EGL display" << std::endl;
+		return false;
+	}
+
+	// Desktop OpenGL (not GLES)
+	if(!eglBindAPI(EGL_OPENGL_API)) {
+		std::cerr << "Error: EGL does not support desktop OpenGL" << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	// Choose any OpenGL capable config (rendering goes to an FBO)
+	const EGLint config_attribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = NULL;
+	EGLint num_configs = 0;
+	eglChooseConfig(display, config_attribs, &config, 1, &num_configs);
+
+	// Request a core profile context with specific version
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, num_configs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, context_attribs);
+
+	// Check context
+	if(context == EGL_NO_CONTEXT) {
+		std::cerr << "Error: could not create EGL context" << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	// Make current without a surface (EGL_KHR_surfaceless_context)
+	if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		std::cerr << "Error: could not make EGL context current" << std::endl;
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+
+	headless.display = display;
+	headless.context = context;
+	return true;
+#else
+	// Print Error
+	std::cerr << "Error: headless rendering is only supported on Linux (EGL)" << std::endl;
+	return false;
+#endif
+}
+
+// Release a headless context
+void destroyHeadlessContext(HeadlessContext &headless) {
+#if defined(__linux__)
+	if(headless.display != NULL) {
+		eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if(headless.context != NULL) {
+			eglDestroyContext(headless.display, headless.context);
+		}
+		eglTerminate(headless.display);
+	}
+#endif
+
+	headless.display = NULL;
+	headless.context = NULL;
+}
+
+// Create a framebuffer object with colour and depth renderbuffers
+GLuint createFramebuffer(int width, int height, GLuint &colour, GLuint &depth) {
+	// Framebuffer
+	GLuint framebuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	// Colour attachment
+	glGenRenderbuffers(1, &colour);
+	glBindRenderbuffer(GL_RENDERBUFFER, colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+
+	// Depth attachment
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// Check completeness
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		// Print Error
+		std::cerr << "Error: framebuffer incomplete" << std::endl;
+
+		// Delete Framebuffer
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteRenderbuffers(1, &colour);
+		glDeleteRenderbuffers(1, &depth);
+		glDeleteFramebuffers(1, &framebuffer);
+		colour = 0;
+		depth = 0;
+
+		// Return Error
+		return 0;
+	}
+
+	// Leave the framebuffer bound for drawing
+	return framebuffer;
+}